@@ -0,0 +1,436 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// Runs somebar against a minimal Wayland compositor in this process, feeds
+// it dwl lines on stdin and commands on its fifo, and reports the time from
+// writing a line to somebar committing the redrawn bar.
+// The compositor answers frame callbacks and releases buffers as soon as
+// the surface is committed, so the latency is somebar's own: waking up,
+// parsing, painting and two round trips for the frame callback.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <wayland-server.h>
+#include "wlr-layer-shell-unstable-v1-server-protocol.h"
+#include "xdg-output-unstable-v1-server-protocol.h"
+
+#ifndef SOMEBAR_PATH
+#define SOMEBAR_PATH "somebar"
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int outputWidth = 1920;
+constexpr const char* outputName = "BENCH-1";
+constexpr int warmupLines = 50;
+constexpr int lines = 1000;
+constexpr auto commitTimeout = std::chrono::seconds {2};
+
+struct Surface {
+	wl_resource* resource;
+	wl_resource* pendingBuffer {nullptr};
+	std::vector<wl_resource*> frames;
+	wl_resource* layerSurface {nullptr};
+	uint32_t width {0}, height {0};
+	bool configured {false};
+};
+
+static wl_display* display;
+static wl_event_loop* eventLoop;
+static pid_t somebarPid;
+// surface commits that attached a buffer, and when the last one arrived
+static unsigned long commits;
+static Clock::time_point lastCommit;
+
+static void die(const char* why)
+{
+	fprintf(stderr, "error: %s\n", why);
+	if (somebarPid > 0) {
+		kill(somebarPid, SIGTERM);
+	}
+	exit(1);
+}
+
+static void destroyResource(wl_client*, wl_resource* resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct wl_region_interface regionImpl = {
+	.destroy = destroyResource,
+	.add = [](wl_client*, wl_resource*, int32_t, int32_t, int32_t, int32_t) { },
+	.subtract = [](wl_client*, wl_resource*, int32_t, int32_t, int32_t, int32_t) { },
+};
+
+static void onCallbackDestroyed(wl_resource* callback)
+{
+	// the surface clears this when it goes first
+	if (auto surface = static_cast<Surface*>(wl_resource_get_user_data(callback))) {
+		auto& frames = surface->frames;
+		frames.erase(std::remove(frames.begin(), frames.end(), callback), frames.end());
+	}
+}
+
+static const struct wl_surface_interface surfaceImpl = {
+	.destroy = destroyResource,
+	.attach = [](wl_client*, wl_resource* resource, wl_resource* buffer, int32_t, int32_t) {
+		static_cast<Surface*>(wl_resource_get_user_data(resource))->pendingBuffer = buffer;
+	},
+	.damage = [](wl_client*, wl_resource*, int32_t, int32_t, int32_t, int32_t) { },
+	.frame = [](wl_client* client, wl_resource* resource, uint32_t id) {
+		auto surface = static_cast<Surface*>(wl_resource_get_user_data(resource));
+		auto callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+		if (!callback) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		wl_resource_set_implementation(callback, nullptr, surface, onCallbackDestroyed);
+		surface->frames.push_back(callback);
+	},
+	.set_opaque_region = [](wl_client*, wl_resource*, wl_resource*) { },
+	.set_input_region = [](wl_client*, wl_resource*, wl_resource*) { },
+	.commit = [](wl_client*, wl_resource* resource) {
+		auto surface = static_cast<Surface*>(wl_resource_get_user_data(resource));
+		if (surface->layerSurface && !surface->configured) {
+			// the initial commit of a layer surface asks for a configure
+			surface->configured = true;
+			zwlr_layer_surface_v1_send_configure(surface->layerSurface, wl_display_next_serial(display),
+				surface->width ? surface->width : outputWidth, surface->height);
+		}
+		if (surface->pendingBuffer) {
+			// a real compositor would upload the shm buffer here
+			wl_buffer_send_release(surface->pendingBuffer);
+			surface->pendingBuffer = nullptr;
+			commits++;
+			lastCommit = Clock::now();
+		}
+		// frames are presented immediately
+		auto frames = std::move(surface->frames);
+		surface->frames.clear();
+		for (auto callback : frames) {
+			wl_resource_set_user_data(callback, nullptr);
+			wl_callback_send_done(callback, 0);
+			wl_resource_destroy(callback);
+		}
+	},
+	.set_buffer_transform = [](wl_client*, wl_resource*, int32_t) { },
+	.set_buffer_scale = [](wl_client*, wl_resource*, int32_t) { },
+	.damage_buffer = [](wl_client*, wl_resource*, int32_t, int32_t, int32_t, int32_t) { },
+};
+
+static void onSurfaceDestroyed(wl_resource* resource)
+{
+	auto surface = static_cast<Surface*>(wl_resource_get_user_data(resource));
+	for (auto callback : surface->frames) {
+		wl_resource_set_user_data(callback, nullptr);
+	}
+	if (surface->layerSurface) {
+		wl_resource_set_user_data(surface->layerSurface, nullptr);
+	}
+	delete surface;
+}
+
+static const struct wl_compositor_interface compositorImpl = {
+	.create_surface = [](wl_client* client, wl_resource* resource, uint32_t id) {
+		auto surface = wl_resource_create(client, &wl_surface_interface, wl_resource_get_version(resource), id);
+		if (!surface) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		wl_resource_set_implementation(surface, &surfaceImpl, new Surface {surface}, onSurfaceDestroyed);
+	},
+	.create_region = [](wl_client* client, wl_resource*, uint32_t id) {
+		auto region = wl_resource_create(client, &wl_region_interface, 1, id);
+		if (!region) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		wl_resource_set_implementation(region, &regionImpl, nullptr, nullptr);
+	},
+};
+
+static Surface* layerSurfaceOwner(wl_resource* resource)
+{
+	return static_cast<Surface*>(wl_resource_get_user_data(resource));
+}
+
+static const struct zwlr_layer_surface_v1_interface layerSurfaceImpl = {
+	.set_size = [](wl_client*, wl_resource* resource, uint32_t width, uint32_t height) {
+		if (auto surface = layerSurfaceOwner(resource)) {
+			surface->width = width;
+			surface->height = height;
+		}
+	},
+	.set_anchor = [](wl_client*, wl_resource*, uint32_t) { },
+	.set_exclusive_zone = [](wl_client*, wl_resource*, int32_t) { },
+	.set_margin = [](wl_client*, wl_resource*, int32_t, int32_t, int32_t, int32_t) { },
+	.set_keyboard_interactivity = [](wl_client*, wl_resource*, uint32_t) { },
+	.get_popup = [](wl_client*, wl_resource*, wl_resource*) { },
+	.ack_configure = [](wl_client*, wl_resource*, uint32_t) { },
+	.destroy = destroyResource,
+	.set_layer = [](wl_client*, wl_resource*, uint32_t) { },
+};
+
+static const struct zwlr_layer_shell_v1_interface layerShellImpl = {
+	.get_layer_surface = [](wl_client* client, wl_resource* resource, uint32_t id,
+		wl_resource* surfaceResource, wl_resource*, uint32_t, const char*)
+	{
+		auto layerSurface = wl_resource_create(client, &zwlr_layer_surface_v1_interface,
+			wl_resource_get_version(resource), id);
+		if (!layerSurface) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		auto surface = static_cast<Surface*>(wl_resource_get_user_data(surfaceResource));
+		surface->layerSurface = layerSurface;
+		surface->configured = false;
+		wl_resource_set_implementation(layerSurface, &layerSurfaceImpl, surface, [](wl_resource* resource) {
+			if (auto surface = layerSurfaceOwner(resource)) {
+				surface->layerSurface = nullptr;
+			}
+		});
+	},
+	.destroy = destroyResource,
+};
+
+static const struct zxdg_output_v1_interface xdgOutputImpl = {
+	.destroy = destroyResource,
+};
+
+static const struct zxdg_output_manager_v1_interface xdgOutputManagerImpl = {
+	.destroy = destroyResource,
+	.get_xdg_output = [](wl_client* client, wl_resource* resource, uint32_t id, wl_resource*) {
+		auto version = wl_resource_get_version(resource);
+		auto output = wl_resource_create(client, &zxdg_output_v1_interface, version, id);
+		if (!output) {
+			wl_client_post_no_memory(client);
+			return;
+		}
+		wl_resource_set_implementation(output, &xdgOutputImpl, nullptr, nullptr);
+		zxdg_output_v1_send_logical_position(output, 0, 0);
+		zxdg_output_v1_send_logical_size(output, outputWidth, 1080);
+		if (version >= 2) {
+			zxdg_output_v1_send_name(output, outputName);
+		}
+		if (version < 3) {
+			zxdg_output_v1_send_done(output);
+		}
+	},
+};
+
+static const struct wl_output_interface outputImpl = {
+	.release = destroyResource,
+};
+
+struct Global {
+	const wl_interface* interface;
+	const void* implementation;
+};
+static Global compositorGlobal {&wl_compositor_interface, &compositorImpl};
+static Global layerShellGlobal {&zwlr_layer_shell_v1_interface, &layerShellImpl};
+static Global xdgOutputManagerGlobal {&zxdg_output_manager_v1_interface, &xdgOutputManagerImpl};
+
+static void bindGlobal(wl_client* client, void* data, uint32_t version, uint32_t id)
+{
+	auto global = static_cast<Global*>(data);
+	auto resource = wl_resource_create(client, global->interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, global->implementation, nullptr, nullptr);
+}
+
+static void bindOutput(wl_client* client, void*, uint32_t version, uint32_t id)
+{
+	auto resource = wl_resource_create(client, &wl_output_interface, version, id);
+	if (!resource) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+	wl_resource_set_implementation(resource, &outputImpl, nullptr, nullptr);
+	wl_output_send_geometry(resource, 0, 0, 530, 300, WL_OUTPUT_SUBPIXEL_UNKNOWN,
+		"somebar", "bench", WL_OUTPUT_TRANSFORM_NORMAL);
+	wl_output_send_mode(resource, WL_OUTPUT_MODE_CURRENT, outputWidth, 1080, 60000);
+	if (version >= 2) {
+		wl_output_send_done(resource);
+	}
+}
+
+// serves somebar until it has committed more than count buffers
+static bool waitForCommit(unsigned long count)
+{
+	auto deadline = Clock::now() + commitTimeout;
+	while (commits <= count) {
+		auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - Clock::now());
+		if (left.count() <= 0) {
+			if (waitpid(somebarPid, nullptr, WNOHANG) == somebarPid) {
+				somebarPid = 0;
+				die("somebar exited");
+			}
+			return false;
+		}
+		wl_display_flush_clients(display);
+		if (wl_event_loop_dispatch(eventLoop, left.count()) < 0) {
+			die("wl_event_loop_dispatch");
+		}
+	}
+	wl_display_flush_clients(display);
+	return true;
+}
+
+static void writeAll(int fd, const std::string& text)
+{
+	if (write(fd, text.c_str(), text.size()) != static_cast<ssize_t>(text.size())) {
+		die("write to somebar");
+	}
+}
+
+struct Scenario {
+	const char* name;
+	bool fifo;
+	std::string (*text)(int i);
+};
+
+static const Scenario scenarios[] = {
+	{"tags", false, [](int i) {
+		return std::string {outputName} + " tags 511 " + std::to_string(1 << (i % 9)) + " 1 0\n";
+	}},
+	{"title", false, [](int i) {
+		return std::string {outputName} + " title Mozilla Firefox - tab " + std::to_string(i) + "\n";
+	}},
+	{"focus-change", false, [](int i) {
+		// what dwl prints when the focus moves to another tag
+		auto out = std::string {outputName};
+		return out + " title window " + std::to_string(i) + "\n"
+			+ out + " tags 511 " + std::to_string(1 << (i % 9)) + " 1 0\n"
+			+ out + " layout " + (i % 2 ? "[]=" : "[M]") + "\n";
+	}},
+	{"title-burst", false, [](int i) {
+		// several lines before somebar wakes up, only the last one is drawn
+		auto out = std::string {};
+		for (auto j = 0; j < 10; j++) {
+			out += std::string {outputName} + " title burst " + std::to_string(i) + "." + std::to_string(j) + "\n";
+		}
+		return out;
+	}},
+	{"status-fifo", true, [](int i) {
+		return "status vol 42% | cpu " + std::to_string(i % 100) + "% | 12:34:" + std::to_string(i % 60) + "\n";
+	}},
+	{"block-fifo", true, [](int i) {
+		return "block cpu cpu " + std::to_string(i) + "%\n";
+	}},
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+	return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+int main(int argc, char* argv[])
+{
+	auto somebar = argc > 1 ? argv[1] : SOMEBAR_PATH;
+	signal(SIGPIPE, SIG_IGN);
+
+	display = wl_display_create();
+	if (!display) {
+		die("wl_display_create");
+	}
+	auto socket = wl_display_add_socket_auto(display);
+	if (!socket) {
+		die("wl_display_add_socket_auto");
+	}
+	eventLoop = wl_display_get_event_loop(display);
+	if (wl_display_init_shm(display) < 0) {
+		die("wl_display_init_shm");
+	}
+	wl_global_create(display, &wl_compositor_interface, 4, &compositorGlobal, bindGlobal);
+	wl_global_create(display, &zwlr_layer_shell_v1_interface, 4, &layerShellGlobal, bindGlobal);
+	wl_global_create(display, &zxdg_output_manager_v1_interface, 3, &xdgOutputManagerGlobal, bindGlobal);
+	wl_global_create(display, &wl_output_interface, 3, nullptr, bindOutput);
+
+	char dir[] = "/tmp/somebar-latency-XXXXXX";
+	if (!mkdtemp(dir)) {
+		die("mkdtemp");
+	}
+	auto fifoPath = std::string {dir} + "/somebar";
+	int stdinPipe[2];
+	if (pipe2(stdinPipe, O_CLOEXEC) < 0) {
+		die("pipe");
+	}
+	somebarPid = fork();
+	if (somebarPid < 0) {
+		die("fork");
+	}
+	if (somebarPid == 0) {
+		dup2(stdinPipe[0], STDIN_FILENO);
+		setenv("WAYLAND_DISPLAY", socket, 1);
+		execl(somebar, "somebar", "-s", fifoPath.c_str(), nullptr);
+		perror(somebar);
+		_exit(1);
+	}
+	close(stdinPipe[0]);
+	auto somebarStdin = stdinPipe[1];
+
+	// dwl prints the state of every monitor when it starts
+	auto out = std::string {outputName};
+	writeAll(somebarStdin, out + " selmon 1\n" + out + " tags 1 1 1 0\n"
+		+ out + " layout []=\n" + out + " title bench\n");
+	if (!waitForCommit(0)) {
+		die("somebar did not draw the bar");
+	}
+	auto fifo = open(fifoPath.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fifo < 0) {
+		die("open somebar fifo");
+	}
+
+	printf("%-14s %10s %10s %10s %10s %6s\n", "scenario", "p50 us", "p90 us", "p99 us", "max us", "lost");
+	auto line = 0;
+	for (const auto& scenario : scenarios) {
+		auto latencies = std::vector<double> {};
+		auto lost = 0;
+		for (auto i = 0; i < warmupLines + lines; i++, line++) {
+			auto count = commits;
+			auto start = Clock::now();
+			writeAll(scenario.fifo ? fifo : somebarStdin, scenario.text(line));
+			if (!waitForCommit(count)) {
+				lost++;
+				continue;
+			}
+			if (i >= warmupLines) {
+				latencies.push_back(std::chrono::duration<double, std::micro>(lastCommit - start).count());
+			}
+		}
+		if (latencies.empty()) {
+			printf("%-14s %10s %10s %10s %10s %6d\n", scenario.name, "-", "-", "-", "-", lost);
+			continue;
+		}
+		std::sort(latencies.begin(), latencies.end());
+		printf("%-14s %10.1f %10.1f %10.1f %10.1f %6d\n", scenario.name,
+			percentile(latencies, 0.5), percentile(latencies, 0.9),
+			percentile(latencies, 0.99), latencies.back(), lost);
+	}
+
+	// somebar exits at the end of its input
+	close(fifo);
+	close(somebarStdin);
+	while (waitpid(somebarPid, nullptr, WNOHANG) == 0) {
+		wl_display_flush_clients(display);
+		wl_event_loop_dispatch(eventLoop, 10);
+	}
+	wl_display_destroy(display);
+	// somebar keeps its state snapshot next to the fifo
+	unlink((fifoPath + ".state").c_str());
+	if (rmdir(dir) < 0) {
+		perror(dir);
+	}
+}
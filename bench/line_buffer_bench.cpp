@@ -0,0 +1,66 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// Feeds a synthetic mix of dwl and status lines through LineBuffer, in
+// chunks the size a pipe read typically returns, and reports throughput.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include "line_buffer.hpp"
+
+constexpr size_t totalBytes = size_t {256} << 20;
+
+static std::string makeInput()
+{
+	auto input = std::string {};
+	auto title = std::string(300, 't');
+	auto status = std::string(2000, 's');
+	while (input.size() < size_t {4} << 20) {
+		input += "eDP-1 title " + title + "\n";
+		input += "eDP-1 selmon 1\n";
+		input += "eDP-1 tags 5 1 1 0\n";
+		input += "eDP-1 layout []=\n";
+		input += "status " + status + "\n";
+	}
+	return input;
+}
+
+static void run(size_t chunkSize, const std::string& input)
+{
+	auto buffer = LineBuffer {};
+	auto offset = size_t {0};
+	auto fed = size_t {0};
+	auto lines = size_t {0};
+	auto lineBytes = size_t {0};
+	auto start = std::chrono::steady_clock::now();
+	while (fed < totalBytes) {
+		buffer.readLines(
+			[&](char* p, size_t size) -> ssize_t {
+				if (fed >= totalBytes) {
+					return -1;
+				}
+				auto n = std::min({size, chunkSize, input.size() - offset});
+				memcpy(p, input.data() + offset, n);
+				offset = (offset + n) % input.size();
+				fed += n;
+				return n;
+			},
+			[&](const char*, size_t size) {
+				lines++;
+				lineBytes += size;
+			});
+	}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	printf("%8zu %10.0f %12.0f %12zu\n", chunkSize, fed / elapsed / (1 << 20), lines / elapsed, lineBytes / lines);
+}
+
+int main()
+{
+	auto input = makeInput();
+	printf("%8s %10s %12s %12s\n", "chunk", "MiB/s", "lines/s", "avg line");
+	for (auto chunkSize : {512, 4096, 65536}) {
+		run(chunkSize, input);
+	}
+}
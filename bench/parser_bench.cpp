@@ -0,0 +1,140 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// Parses typical dwl and status fifo traffic with the command parser, and
+// with the istringstream and rfind based parsing somebar used before, for
+// comparison.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "command.hpp"
+
+static unsigned long allocations;
+void* operator new(size_t size)
+{
+	allocations++;
+	if (auto p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc {};
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+constexpr int iterations = 200000;
+
+// what dwl prints for every monitor on a focus change
+static const std::vector<std::string> dwlLines = {
+	"eDP-1 title Mozilla Firefox - somebar: dwm-like bar for dwl",
+	"eDP-1 appid firefox",
+	"eDP-1 fullscreen 0",
+	"eDP-1 floating 0",
+	"eDP-1 selmon 1",
+	"eDP-1 tags 5 1 1 0",
+	"eDP-1 layout []=",
+	"DP-2 title foot",
+	"DP-2 selmon 0",
+	"DP-2 tags 258 2 2 256",
+	"DP-2 layout [M]",
+};
+
+// what status scripts and somebar -c write to the fifo
+static const std::vector<std::string> fifoLines = {
+	"status vol 42% | bat 87% | Fri 17 Oct 12:34:56",
+	"status vol 42% | bat 87% | Fri 17 Oct 12:34:57",
+	"status vol 40% | bat 87% | Fri 17 Oct 12:34:57",
+	"toggle selected",
+	"hide all",
+	"show eDP-1",
+};
+
+static volatile uint32_t sink;
+
+static void parseDwl(const std::string& line)
+{
+	Command cmd;
+	if (parseDwlCommand(line, cmd)) {
+		sink += static_cast<uint32_t>(cmd.verb) + cmd.numbers[1] + cmd.argument.size();
+	}
+}
+
+static void parseDwlStream(const std::string& line)
+{
+	std::string monName, command;
+	auto stream = std::istringstream {line};
+	stream >> monName >> command;
+	if (!stream.good()) {
+		return;
+	}
+	if (command == "title" || command == "layout") {
+		auto text = std::string {};
+		std::getline(stream, text);
+		sink += text.size();
+	} else if (command == "selmon") {
+		uint32_t selected;
+		stream >> selected;
+		sink += selected;
+	} else if (command == "tags") {
+		uint32_t occupied, tags, clientTags, urgent;
+		stream >> occupied >> tags >> clientTags >> urgent;
+		sink += tags;
+	}
+}
+
+static void parseFifo(const std::string& line)
+{
+	Command cmd;
+	if (parseControlCommand(line, cmd)) {
+		sink += static_cast<uint32_t>(cmd.verb) + cmd.argument.size();
+	}
+}
+
+// the prefix matching onStatus() did before
+static const std::string prefixStatus = "status ";
+static const std::string prefixShow = "show ";
+static const std::string prefixHide = "hide ";
+static const std::string prefixToggle = "toggle ";
+static void parseFifoPrefix(const std::string& line)
+{
+	auto str = std::string {line};
+	if (str.rfind(prefixStatus, 0) == 0) {
+		sink += str.substr(prefixStatus.size()).size();
+	} else if (str.rfind(prefixShow, 0) == 0) {
+		sink += str.substr(prefixShow.size()).size();
+	} else if (str.rfind(prefixHide, 0) == 0) {
+		sink += str.substr(prefixHide.size()).size();
+	} else if (str.rfind(prefixToggle, 0) == 0) {
+		sink += str.substr(prefixToggle.size()).size();
+	}
+}
+
+template<typename Parser>
+static void run(const char* name, const std::vector<std::string>& lines, Parser parse)
+{
+	auto allocationsBefore = allocations;
+	auto start = std::chrono::steady_clock::now();
+	for (auto i = 0; i < iterations; i++) {
+		for (const auto& line : lines) {
+			parse(line);
+		}
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	auto count = static_cast<double>(iterations) * lines.size();
+	printf("%-18s %10.1f %10.2f\n", name,
+		std::chrono::duration<double, std::nano>(elapsed).count() / count,
+		(allocations - allocationsBefore) / count);
+}
+
+int main()
+{
+	printf("%-18s %10s %10s\n", "parser", "ns/line", "allocs");
+	run("dwl string_view", dwlLines, parseDwl);
+	run("dwl istringstream", dwlLines, parseDwlStream);
+	run("fifo string_view", fifoLines, parseFifo);
+	run("fifo rfind", fifoLines, parseFifoPrefix);
+}
@@ -0,0 +1,157 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+// Renders a bar into a plain cairo image surface, without a Wayland
+// connection, and reports the cost per frame.
+// Allocations only count operator new, not what pango and cairo allocate
+// with malloc. Shaping calls are misses of the layout cache.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+#include <cairo/cairo.h>
+#include "bar.hpp"
+#include "glyph_atlas.hpp"
+#include "layout_cache.hpp"
+
+// referenced by bar.cpp and config.hpp, normally defined in main.cpp
+wl_display* display;
+wl_compositor* compositor;
+wl_shm* shm;
+zwlr_layer_shell_v1* wlrLayerShell;
+void spawn(Monitor&, const Arg&) { }
+void blockClicked(Monitor&, std::string_view, int) { }
+void setCloexec(int) { }
+void die(const char* why)
+{
+	fprintf(stderr, "error: %s failed, aborting\n", why);
+	exit(1);
+}
+void diesys(const char* why)
+{
+	perror(why);
+	exit(1);
+}
+
+static unsigned long allocations;
+void* operator new(size_t size)
+{
+	allocations++;
+	if (auto p = malloc(size ? size : 1)) {
+		return p;
+	}
+	throw std::bad_alloc {};
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+constexpr int barHeight = 26;
+constexpr int warmupFrames = 200;
+constexpr int frames = 5000;
+
+static std::vector<std::string> titles;
+static std::vector<std::string> statuses;
+static std::vector<std::string> clocks;
+
+struct Scenario {
+	const char* name;
+	void (*update)(Bar& bar, int frame);
+};
+
+static const Scenario scenarios[] = {
+	{"idle", [](Bar&, int) { }},
+	{"clock", [](Bar& bar, int frame) {
+		bar.setStatus(statuses[frame % statuses.size()]);
+	}},
+	{"clock-block", [](Bar& bar, int frame) {
+		// only the clock block changes, the other blocks keep their layout
+		bar.setStatus("vol 42%");
+		bar.setBlock("battery", "bat 87%");
+		bar.setBlock("clock", clocks[frame % clocks.size()]);
+	}},
+	{"status-burst", [](Bar& bar, int frame) {
+		// several producer lines between two frames, only the last one is shown
+		for (auto i = 0; i < 10; i++) {
+			bar.setStatus(statuses[(frame*10 + i) % statuses.size()]);
+		}
+	}},
+	{"long-title", [](Bar& bar, int frame) {
+		bar.setTitle(titles[frame % titles.size()]);
+	}},
+	{"urgent-tags", [](Bar& bar, int frame) {
+		for (auto tag = 0; tag < 9; tag++) {
+			bar.setTag(tag, frame % 2 ? TagState::Urgent : TagState::None, 1, tag == 0 ? 0 : -1);
+		}
+	}},
+	{"focus-change", [](Bar& bar, int frame) {
+		bar.setSelected(frame % 2);
+		bar.setTitle(titles[frame % titles.size()]);
+		bar.setTag(frame % 9, TagState::Active, 2, 0);
+		bar.setTag((frame+8) % 9, TagState::None, 1, -1);
+	}},
+};
+
+static void run(const Scenario& scenario, int width)
+{
+	auto img = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, barHeight);
+	auto painter = cairo_create(img);
+	auto canvas = Canvas {cairo_image_surface_get_data(img), width, barHeight,
+		cairo_image_surface_get_stride(img)};
+	{
+		auto bar = Bar {};
+		bar.setLayout("[]=");
+		bar.setTitle(titles[0]);
+		bar.setStatus(statuses[0]);
+		for (auto i = 0; i < warmupFrames; i++) {
+			scenario.update(bar, i);
+			bar.paint(painter, canvas);
+		}
+
+		auto elapsed = std::chrono::nanoseconds {0};
+		auto allocationsBefore = allocations;
+		auto shapingBefore = LayoutCache::get().stats.misses;
+		auto glyphMissesBefore = GlyphAtlas::get().stats.misses;
+		auto damaged = 0l;
+		for (auto i = 0; i < frames; i++) {
+			scenario.update(bar, warmupFrames + i);
+			auto start = std::chrono::steady_clock::now();
+			auto& damage = bar.paint(painter, canvas);
+			elapsed += std::chrono::steady_clock::now() - start;
+			for (auto span : damage) {
+				damaged += span.width;
+			}
+		}
+		printf("%-14s %5d %10.0f %10.2f %10.2f %10.2f %8.0f\n",
+			scenario.name,
+			width,
+			static_cast<double>(elapsed.count()) / frames,
+			static_cast<double>(allocations - allocationsBefore) / frames,
+			static_cast<double>(LayoutCache::get().stats.misses - shapingBefore) / frames,
+			static_cast<double>(GlyphAtlas::get().stats.misses - glyphMissesBefore) / frames,
+			static_cast<double>(damaged) / frames);
+	}
+	cairo_destroy(painter);
+	cairo_surface_destroy(img);
+}
+
+int main()
+{
+	// more distinct strings than frames would make every frame a cache miss
+	for (auto i = 0; i < 60; i++) {
+		titles.push_back("Mozilla Firefox - A very long page title that keeps going and going, "
+			"as page titles do, tab " + std::to_string(i) + " - some more text to fill a 4K bar");
+		statuses.push_back("vol 42% | bat 87% | cpu 3% | mem 2.1G | Fri 17 Oct 12:34:" + std::to_string(i));
+		clocks.push_back("Fri 17 Oct 12:34:" + std::to_string(10 + i % 50));
+	}
+
+	printf("%-14s %5s %10s %10s %10s %10s %8s\n",
+		"scenario", "width", "ns/frame", "allocs", "shaping", "rasterize", "damaged");
+	for (auto width : {1920, 3840}) {
+		for (const auto& scenario : scenarios) {
+			run(scenario, width);
+		}
+	}
+}
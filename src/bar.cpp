@@ -1,11 +1,17 @@
 // somebar - dwl barbar
 // See LICENSE file for copyright and license details.
 
+#include <thread>
 #include <wayland-client-protocol.h>
 #include <pango/pangocairo.h>
 #include "bar.hpp"
 #include "cairo.h"
 #include "config.hpp"
+#include "glyph_atlas.hpp"
+#include "layout_cache.hpp"
+#include "metrics.hpp"
+#include "raster.hpp"
+#include "trace.hpp"
 #include "pango/pango-font.h"
 #include "pango/pango-fontmap.h"
 #include "pango/pango-layout.h"
@@ -19,6 +25,7 @@ const zwlr_layer_surface_v1_listener Bar::_layerSurfaceListener = {
 const wl_callback_listener Bar::_frameListener = {
 	[](void* owner, wl_callback* cb, uint32_t)
 	{
+		auto trace = TraceSpan {"frame"};
 		static_cast<Bar*>(owner)->render();
 		wl_callback_destroy(cb);
 	}
@@ -28,43 +35,104 @@ struct Font {
 	PangoFontDescription* description;
 	int height {0};
 };
-static Font getFont()
+// returns the call that failed, or nullptr. does not touch anything but
+// fontMap, so it can run on the font thread.
+static const char* loadFont(PangoFontMap* fontMap, Font& res)
 {
-	auto fontMap = pango_cairo_font_map_get_default();
-	if (!fontMap) {
-		die("pango_cairo_font_map_get_default");
-	}
 	auto fontDesc = pango_font_description_from_string(font);
 	if (!fontDesc) {
-		die("pango_font_description_from_string");
+		return "pango_font_description_from_string";
 	}
-	auto tempContext = pango_font_map_create_context(fontMap);
+	auto tempContext = wl_unique_ptr<PangoContext> {pango_font_map_create_context(fontMap)};
 	if (!tempContext) {
-		die("pango_font_map_create_context");
+		return "pango_font_map_create_context";
 	}
-	auto font = pango_font_map_load_font(fontMap, tempContext, fontDesc);
+	auto font = pango_font_map_load_font(fontMap, tempContext.get(), fontDesc);
 	if (!font) {
-		die("pango_font_map_load_font");
+		return "pango_font_map_load_font";
 	}
-	auto metrics = pango_font_get_metrics(font, pango_language_get_default());
-	if (!metrics) {
-		die("pango_font_get_metrics");
+	auto fontMetrics = pango_font_get_metrics(font, pango_language_get_default());
+	if (!fontMetrics) {
+		g_object_unref(font);
+		return "pango_font_get_metrics";
 	}
-
-	auto res = Font {};
 	res.description = fontDesc;
-	res.height = PANGO_PIXELS(pango_font_metrics_get_height(metrics));
-
-	pango_font_metrics_unref(metrics);
+	res.height = PANGO_PIXELS(pango_font_metrics_get_height(fontMetrics));
+	pango_font_metrics_unref(fontMetrics);
 	g_object_unref(font);
-	g_object_unref(tempContext);
-	return res;
+
+	// shape the tag names once with the font options bars are drawn with,
+	// so the first frame finds the font and its glyphs in the map's caches
+	auto img = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1)};
+	auto painter = wl_unique_ptr<cairo_t> {cairo_create(img.get())};
+	pango_cairo_update_context(painter.get(), tempContext.get());
+	auto sample = std::string {};
+	for (const auto& tagName : tagNames) {
+		sample += tagName;
+	}
+	auto layout = pango_layout_new(tempContext.get());
+	pango_layout_set_font_description(layout, fontDesc);
+	pango_layout_set_text(layout, sample.c_str(), sample.size());
+	int w, h;
+	pango_layout_get_size(layout, &w, &h);
+	g_object_unref(layout);
+	return nullptr;
+}
+
+// started by preloadFont(). never destroyed, exit() must not find it
+// joinable.
+static std::thread* fontThread;
+static PangoFontMap* fontThreadMap;
+static Font fontThreadResult;
+static const char* fontThreadError;
+static uint64_t fontThreadDone;
+
+void preloadFont()
+{
+	fontThread = new std::thread {[]() {
+		fontThreadMap = pango_cairo_font_map_new();
+		fontThreadError = fontThreadMap
+			? loadFont(fontThreadMap, fontThreadResult)
+			: "pango_cairo_font_map_new";
+		fontThreadDone = nowNs();
+	}};
+}
+
+// loaded on first use, so somebar -c never initializes fontconfig
+static const Font& barfont()
+{
+	static auto font = []() {
+		auto res = Font {};
+		const char* error;
+		if (fontThread) {
+			auto start = nowNs();
+			fontThread->join();
+			metrics.startup.fontWait = nowNs() - start;
+			metrics.startup.fontLoaded = fontThreadDone - metrics.startTime;
+			res = fontThreadResult;
+			error = fontThreadError;
+			if (fontThreadMap) {
+				// layouts are created on this thread, from its default map
+				pango_cairo_font_map_set_default(PANGO_CAIRO_FONT_MAP(fontThreadMap));
+				g_object_unref(fontThreadMap);
+			}
+		} else {
+			auto fontMap = pango_cairo_font_map_get_default();
+			error = fontMap ? loadFont(fontMap, res) : "pango_cairo_font_map_get_default";
+		}
+		if (error) {
+			die(error);
+		}
+		return res;
+	}();
+	return font;
 }
-static Font barfont = getFont();
+constexpr PixelScheme pixelsInactive = toPixels(colorInactive);
+constexpr PixelScheme pixelsActive = toPixels(colorActive);
 
-BarComponent::BarComponent() { }
-BarComponent::BarComponent(wl_unique_ptr<PangoLayout> layout)
-	: pangoLayout {std::move(layout)}
+BarComponent::BarComponent(const std::string& initial)
+	: _text {initial}
+	, _textChanged {true}
 {
 }
 
@@ -75,24 +143,43 @@ int BarComponent::width() const
 	return PANGO_PIXELS(w);
 }
 
-void BarComponent::setText(const std::string& text)
+void BarComponent::setText(std::string_view text)
 {
-	_text = std::make_unique<std::string>(text);
-	pango_layout_set_text(pangoLayout.get(), _text->c_str(), _text->size());
+	if (_text != text) {
+		_text.assign(text);
+		_textChanged = true;
+	}
 }
 
-Bar::Bar()
+void BarComponent::shape()
 {
-	_pangoContext.reset(pango_font_map_create_context(pango_cairo_font_map_get_default()));
-	if (!_pangoContext) {
-		die("pango_font_map_create_context");
+	if (!_textChanged) {
+		return;
+	}
+	_textChanged = false;
+	if (pangoLayout && _text == pango_layout_get_text(pangoLayout.get())) {
+		return;
 	}
+	pangoLayout = LayoutCache::get().layout(_text, barfont().description, 1);
+	dirty = true;
+}
+
+bool BarComponent::needsRepaint() const
+{
+	return dirty || x != drawn.x || size != drawn.width;
+}
+
+bool BarComponent::empty() const
+{
+	return _text.empty();
+}
+
+Bar::Bar()
+{
 	for (const auto& tagName : tagNames) {
-		_tags.push_back({ TagState::None, 0, 0, createComponent(tagName) });
+		_tags.push_back({ TagState::None, 0, 0, BarComponent {tagName} });
 	}
-	_layoutCmp = createComponent();
-	_titleCmp = createComponent();
-	_statusCmp = createComponent();
+	_blocks.push_back({std::string {statusBlockId}, BarComponent {}});
 }
 
 const wl_surface* Bar::surface() const
@@ -102,7 +189,7 @@ const wl_surface* Bar::surface() const
 
 bool Bar::visible() const
 {
-	return _surface.get();
+	return _surface.get() && !_hidden;
 }
 
 void Bar::show(wl_output* output)
@@ -110,18 +197,33 @@ void Bar::show(wl_output* output)
 	if (visible()) {
 		return;
 	}
+	if (_hidden) {
+		// a commit without a buffer maps the layer surface again. the
+		// configure that follows presents the kept frame.
+		_hidden = false;
+		_remap = true;
+		_awaitingConfigure = true;
+		setupLayerSurface();
+		wl_surface_commit(_surface.get());
+		return;
+	}
 	_surface.reset(wl_compositor_create_surface(compositor));
 	_layerSurface.reset(zwlr_layer_shell_v1_get_layer_surface(wlrLayerShell,
 		_surface.get(), output, ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM, "net.tapesoftware.Somebar"));
 	zwlr_layer_surface_v1_add_listener(_layerSurface.get(), &_layerSurfaceListener, this);
+	setupLayerSurface();
+	wl_surface_commit(_surface.get());
+}
+
+void Bar::setupLayerSurface()
+{
 	auto anchor = topbar ? ZWLR_LAYER_SURFACE_V1_ANCHOR_TOP : ZWLR_LAYER_SURFACE_V1_ANCHOR_BOTTOM;
 	zwlr_layer_surface_v1_set_anchor(_layerSurface.get(),
 		anchor | ZWLR_LAYER_SURFACE_V1_ANCHOR_LEFT | ZWLR_LAYER_SURFACE_V1_ANCHOR_RIGHT);
 
-	auto barSize = barfont.height + paddingY * 2;
+	auto barSize = barfont().height + paddingY * 2;
 	zwlr_layer_surface_v1_set_size(_layerSurface.get(), 0, barSize);
 	zwlr_layer_surface_v1_set_exclusive_zone(_layerSurface.get(), barSize);
-	wl_surface_commit(_surface.get());
 }
 
 void Bar::hide()
@@ -129,6 +231,20 @@ void Bar::hide()
 	if (!visible()) {
 		return;
 	}
+	// unmaps the layer surface, and releases its exclusive zone
+	_hidden = true;
+	_invalid = false;
+	wl_surface_attach(_surface.get(), nullptr, 0, 0);
+	wl_surface_commit(_surface.get());
+}
+
+void Bar::reclaim()
+{
+	if (!_hidden) {
+		return;
+	}
+	_hidden = false;
+	_remap = false;
 	_layerSurface.reset();
 	_surface.reset();
 	_bufs.reset();
@@ -137,33 +253,61 @@ void Bar::hide()
 void Bar::setTag(int tag, int state, int numClients, int focusedClient)
 {
 	auto& t = _tags[tag];
+	if (t.state == state && t.numClients == numClients && t.focusedClient == focusedClient) {
+		return;
+	}
 	t.state = state;
 	t.numClients = numClients;
 	t.focusedClient = focusedClient;
+	t.component.dirty = true;
 }
 
 void Bar::setSelected(bool selected)
 {
+	if (_selected == selected) {
+		return;
+	}
 	_selected = selected;
+	_layoutCmp.dirty = true;
+	_titleCmp.dirty = true;
+	for (auto& block : _blocks) {
+		block.component.dirty = true;
+	}
 }
-void Bar::setLayout(const std::string& layout)
+void Bar::setLayout(std::string_view layout)
 {
 	_layoutCmp.setText(layout);
 }
-void Bar::setTitle(const std::string& title)
+void Bar::setTitle(std::string_view title)
 {
 	_titleCmp.setText(title);
 }
-void Bar::setStatus(const std::string& status)
+void Bar::setStatus(std::string_view status)
 {
-	_statusCmp.setText(status);
+	setBlock(statusBlockId, status);
+}
+void Bar::setBlock(std::string_view id, std::string_view text)
+{
+	for (auto& block : _blocks) {
+		if (block.id == id) {
+			block.component.setText(text);
+			return;
+		}
+	}
+	_blocks.push_back({std::string {id}, BarComponent {std::string {text}}});
 }
 
 void Bar::invalidate()
 {
-	if (_invalid || !visible()) {
+	// the configure after show() renders everything that changed meanwhile
+	if (!visible() || _awaitingConfigure) {
 		return;
 	}
+	if (_invalid) {
+		metrics.framesCoalesced++;
+		return;
+	}
+	metrics.framesRequested++;
 	_invalid = true;
 	auto frame = wl_surface_frame(_surface.get());
 	wl_callback_add_listener(frame, &_frameListener, this);
@@ -175,18 +319,25 @@ void Bar::click(Monitor* mon, int x, int, int btn)
 	Arg arg = {0};
 	Arg* argp = nullptr;
 	int control = ClkNone;
-	if (x > _statusCmp.x) {
-		control = ClkStatusText;
-	} else if (x > _titleCmp.x) {
-		control = ClkWinTitle;
-	} else if (x > _layoutCmp.x) {
-		control = ClkLayoutSymbol;
-	} else for (auto tag = _tags.size()-1; tag >= 0; tag--) {
-		if (x > _tags[tag].component.x) {
-			control = ClkTagBar;
-			arg.ui = 1<<tag;
+	const StatusBlock* block = nullptr;
+	auto target = std::upper_bound(_clickTargets.begin(), _clickTargets.end(), x,
+		[](int x, const ClickTarget& target) { return x < target.extent.x; });
+	if (target != _clickTargets.begin() && x < (--target)->extent.end()) {
+		control = target->control;
+		if (control == ClkTagBar) {
+			arg.ui = 1<<target->index;
 			argp = &arg;
-			break;
+		} else if (control == ClkStatusText) {
+			block = &_blocks[target->index];
+		}
+	}
+	if (block) {
+		blockClicked(*mon, block->id, btn);
+		for (const auto& button : blockButtons) {
+			if (block->id == button.block && button.btn == btn) {
+				button.func(*mon, button.arg);
+				return;
+			}
 		}
 	}
 	for (const auto& button : buttons) {
@@ -200,116 +351,229 @@ void Bar::click(Monitor* mon, int x, int, int btn)
 void Bar::layerSurfaceConfigure(uint32_t serial, uint32_t width, uint32_t height)
 {
 	zwlr_layer_surface_v1_ack_configure(_layerSurface.get(), serial);
-	if (width == _bufs->width && height == _bufs->height) {
+	_awaitingConfigure = false;
+	metrics.startupPhase(metrics.startup.firstConfigure);
+	if (_bufs && width == _bufs->width && height == _bufs->height) {
+		if (_remap) {
+			render();
+		}
 		return;
 	}
 	_bufs.emplace(width, height, WL_SHM_FORMAT_XRGB8888);
+	_bufs->onRelease = [this]() { render(); };
+	markDirty();
 	render();
 }
 
 void Bar::render()
 {
-	if (!_bufs) {
+	auto trace = TraceSpan {"render"};
+	if (!_bufs || _hidden || _awaitingConfigure) {
 		return;
 	}
-	auto img = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create_for_data(
-		_bufs->data(),
-		CAIRO_FORMAT_ARGB32,
-		_bufs->width,
-		_bufs->height,
-		_bufs->stride
-		)};
-	auto painter = wl_unique_ptr<cairo_t> {cairo_create(img.get())};
-	_painter = painter.get();
-	pango_cairo_update_context(_painter, _pangoContext.get());
-	_x = 0;
+	if (!_bufs->acquire()) {
+		// the compositor holds all buffers, onRelease renders again
+		metrics.framesStarved++;
+		return;
+	}
+	paint(_bufs->painter(), Canvas {_bufs->data(), static_cast<int>(_bufs->width),
+		static_cast<int>(_bufs->height), static_cast<int>(_bufs->stride)});
+	_invalid = false;
+	if (_remap) {
+		// the compositor dropped the surface contents when it was unmapped.
+		// the acquired buffer already holds the last frame.
+		_remap = false;
+		_damage.add(Extent {0, static_cast<int>(_bufs->width)});
+	}
+	if (_damage.empty()) {
+		metrics.framesEmpty++;
+		return;
+	}
+	metrics.framesCommitted++;
+	wl_surface_attach(_surface.get(), _bufs->buffer(), 0, 0);
+	for (auto span : _damage) {
+		wl_surface_damage_buffer(_surface.get(), span.x, 0, span.width, _bufs->height);
+	}
+	{
+		auto commit = TraceSpan {"wl_surface_commit"};
+		wl_surface_commit(_surface.get());
+	}
+	_bufs->commit(_damage);
+	metrics.startupPhase(metrics.startup.firstFrame);
+}
+
+const Damage& Bar::paint(cairo_t* painter, const Canvas& canvas)
+{
+	auto timer = ScopedTimer {metrics.paint};
+	auto trace = TraceSpan {"paint"};
+	_painter = painter;
+	_canvas = canvas;
+	_damage.clear();
 
-	renderTags();
-	setColorScheme(_selected ? colorActive : colorInactive);
-	renderComponent(_layoutCmp);
-	renderComponent(_titleCmp);
-	renderStatus();
+	layoutComponents();
+	indexClickTargets();
+	{
+		auto part = ScopedTimer {metrics.paintTags};
+		renderTags();
+	}
+	setColorScheme(_selected ? pixelsActive : pixelsInactive);
+	{
+		auto part = ScopedTimer {metrics.paintLayout};
+		renderComponent(_layoutCmp);
+	}
+	{
+		auto part = ScopedTimer {metrics.paintTitle};
+		renderComponent(_titleCmp);
+	}
+	{
+		auto part = ScopedTimer {metrics.paintStatus};
+		for (auto& block : _blocks) {
+			renderComponent(block.component);
+		}
+	}
 
 	_painter = nullptr;
-	wl_surface_attach(_surface.get(), _bufs->buffer(), 0, 0);
-	wl_surface_damage(_surface.get(), 0, 0, _bufs->width, _bufs->height);
-	wl_surface_commit(_surface.get());
-	_bufs->flip();
-	_invalid = false;
+	return _damage;
+}
+
+void Bar::layoutComponents()
+{
+	auto x = 0;
+	auto place = [&](BarComponent& component) {
+		component.shape();
+		component.x = x;
+		component.size = component.width() + paddingX*2;
+		x += component.size;
+	};
+	for (auto& tag : _tags) {
+		place(tag.component);
+	}
+	place(_layoutCmp);
+	place(_titleCmp);
+
+	// blocks are right-aligned in the order they were created
+	auto statusWidth = 0;
+	for (auto& block : _blocks) {
+		auto& component = block.component;
+		component.shape();
+		component.size = component.empty() ? 0 : component.width() + paddingX*2;
+		statusWidth += component.size;
+	}
+	_statusX = _canvas.width - statusWidth;
+	x = _statusX;
+	for (auto& block : _blocks) {
+		block.component.x = x;
+		x += block.component.size;
+	}
+
+	// the title fills the space up to the status text, and nothing may
+	// overlap the status
+	_titleCmp.size = _statusX - _titleCmp.x;
+	for (auto& tag : _tags) {
+		tag.component.size = std::clamp(tag.component.size, 0, _statusX - tag.component.x);
+	}
+	_layoutCmp.size = std::clamp(_layoutCmp.size, 0, _statusX - _layoutCmp.x);
+	_titleCmp.size = std::max(_titleCmp.size, 0);
+}
+
+void Bar::indexClickTargets()
+{
+	_clickTargets.clear();
+	auto add = [&](const BarComponent& component, int control, int index) {
+		if (component.size > 0) {
+			_clickTargets.push_back({{component.x, component.size}, control, index});
+		}
+	};
+	for (auto i = 0u; i < _tags.size(); i++) {
+		add(_tags[i].component, ClkTagBar, i);
+	}
+	add(_layoutCmp, ClkLayoutSymbol, 0);
+	add(_titleCmp, ClkWinTitle, 0);
+	for (auto i = 0u; i < _blocks.size(); i++) {
+		add(_blocks[i].component, ClkStatusText, i);
+	}
 }
 
 void Bar::renderTags()
 {
 	for (auto &tag : _tags) {
+		if (!tag.component.needsRepaint()) {
+			continue;
+		}
 		setColorScheme(
-			tag.state & TagState::Active ? colorActive : colorInactive,
+			tag.state & TagState::Active ? pixelsActive : pixelsInactive,
 			tag.state & TagState::Urgent);
 		renderComponent(tag.component);
-		auto indicators = std::min(tag.numClients, static_cast<int>(_bufs->height/2));
+		auto indicators = std::min(tag.numClients, _canvas.height/2);
 		for (auto ind = 0; ind < indicators; ind++) {
-			auto w = ind == tag.focusedClient ? 7 : 1;
-			cairo_move_to(_painter, tag.component.x, ind*2+0.5);
-			cairo_rel_line_to(_painter, w, 0);
-			cairo_close_path(_painter);
-			cairo_set_line_width(_painter, 1);
-			cairo_stroke(_painter);
+			auto w = std::min(ind == tag.focusedClient ? 7 : 1, tag.component.size);
+			fillRect(_canvas, tag.component.x, ind*2, w, 1, _colorScheme.fg);
 		}
 	}
 }
 
-void Bar::renderStatus()
+void Bar::markDirty()
 {
-	pango_cairo_update_layout(_painter, _statusCmp.pangoLayout.get());
-	beginBg();
-	auto start = _bufs->width - _statusCmp.width() - paddingX*2;
-	cairo_rectangle(_painter, _x, 0, _bufs->width-_x+start, _bufs->height);
-	cairo_fill(_painter);
-
-	_x = start;
-	renderComponent(_statusCmp);
+	for (auto& tag : _tags) {
+		tag.component.dirty = true;
+	}
+	_layoutCmp.dirty = true;
+	_titleCmp.dirty = true;
+	for (auto& block : _blocks) {
+		block.component.dirty = true;
+	}
 }
 
-void Bar::setColorScheme(const ColorScheme& scheme, bool invert)
+void Bar::setColorScheme(const PixelScheme& scheme, bool invert)
 {
 	_colorScheme = invert
-		? ColorScheme {scheme.bg, scheme.fg}
-		: ColorScheme {scheme.fg, scheme.bg};
+		? PixelScheme {scheme.bg, scheme.fg}
+		: PixelScheme {scheme.fg, scheme.bg};
 }
-static void setColor(cairo_t* painter, const Color& color)
+static void setColor(cairo_t* painter, uint32_t pixel)
 {
+	auto a = pixel >> 24;
+	if (!a) {
+		cairo_set_source_rgba(painter, 0, 0, 0, 0);
+		return;
+	}
 	cairo_set_source_rgba(painter,
-		color.r/255.0, color.g/255.0, color.b/255.0, color.a/255.0);
+		(pixel >> 16 & 0xff)/double(a), (pixel >> 8 & 0xff)/double(a), (pixel & 0xff)/double(a), a/255.0);
 }
 void Bar::beginFg()
 {
 	setColor(_painter, _colorScheme.fg);
 }
-void Bar::beginBg()
-{
-	setColor(_painter, _colorScheme.bg);
-}
 
 void Bar::renderComponent(BarComponent& component)
 {
-	pango_cairo_update_layout(_painter, component.pangoLayout.get());
-	auto size = component.width() + paddingX*2;
-	component.x = _x;
-
-	beginBg();
-	cairo_rectangle(_painter, _x, 0, size, _bufs->height);
-	cairo_fill(_painter);
-	cairo_move_to(_painter, _x+paddingX, paddingY);
-
-	beginFg();
-	pango_cairo_show_layout(_painter, component.pangoLayout.get());
-	_x += size;
-}
+	if (!component.needsRepaint()) {
+		return;
+	}
+	if (component.size <= 0) {
+		component.dirty = false;
+		component.drawn = {component.x, 0};
+		return;
+	}
+	auto extent = Extent {component.x, component.size};
+	auto target = cairo_get_target(_painter);
+	cairo_surface_flush(target);
+	fillRect(_canvas, component.x, 0, component.size, _canvas.height, _colorScheme.bg);
+	auto drawn = GlyphAtlas::get().draw(component.pangoLayout.get(), _canvas,
+		component.x+paddingX, paddingY, extent, _colorScheme.fg);
+	cairo_surface_mark_dirty_rectangle(target, component.x, 0, component.size, _canvas.height);
+	if (!drawn) {
+		cairo_save(_painter);
+		cairo_rectangle(_painter, component.x, 0, component.size, _canvas.height);
+		cairo_clip(_painter);
+		cairo_move_to(_painter, component.x+paddingX, paddingY);
+		beginFg();
+		pango_cairo_show_layout(_painter, component.pangoLayout.get());
+		cairo_restore(_painter);
+		cairo_surface_flush(target);
+	}
 
-BarComponent Bar::createComponent(const std::string &initial)
-{
-	auto layout = pango_layout_new(_pangoContext.get());
-	pango_layout_set_font_description(layout, barfont.description);
-	auto res = BarComponent {wl_unique_ptr<PangoLayout> {layout}};
-	res.setText(initial);
-	return res;
+	component.dirty = false;
+	component.drawn = {component.x, component.size};
+	_damage.add(component.drawn);
 }
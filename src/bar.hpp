@@ -4,21 +4,34 @@
 #pragma once
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <wayland-client.h>
 #include "wlr-layer-shell-unstable-v1-client-protocol.h"
 #include "common.hpp"
+#include "damage.hpp"
+#include "raster.hpp"
 #include "shm_buffer.hpp"
 
 class BarComponent {
-	std::unique_ptr<std::string> _text;
+	std::string _text;
+	bool _textChanged {false};
 public:
-	BarComponent();
-	explicit BarComponent(wl_unique_ptr<PangoLayout> layout);
+	explicit BarComponent(const std::string& initial = {});
 	int width() const;
-	void setText(const std::string& text);
-	wl_unique_ptr<PangoLayout> pangoLayout;
+	void setText(std::string_view text);
+	// updates the layout if the text changed since the last call
+	void shape();
+	bool needsRepaint() const;
+	bool empty() const;
+	// shared with other bars showing the same text
+	std::shared_ptr<PangoLayout> pangoLayout;
 	int x {0};
+	int size {0};
+	// set when the content changed since the component was last drawn
+	bool dirty {true};
+	// where the component was last drawn
+	Extent drawn {-1, 0};
 };
 
 struct Tag {
@@ -28,6 +41,18 @@ struct Tag {
 	BarComponent component;
 };
 
+// a part of the status area, set with the block command. the status
+// command sets the block named "status", which is always the first.
+struct StatusBlock {
+	std::string id;
+	BarComponent component;
+};
+constexpr std::string_view statusBlockId = "status";
+
+// loads the bar font on a thread, so it is ready by the time the first bar
+// is shown. optional, the font is otherwise loaded on first use.
+void preloadFont();
+
 struct Monitor;
 class Bar {
 	static const zwlr_layer_surface_v1_listener _layerSurfaceListener;
@@ -35,40 +60,72 @@ class Bar {
 
 	wl_unique_ptr<wl_surface> _surface;
 	wl_unique_ptr<zwlr_layer_surface_v1> _layerSurface;
-	wl_unique_ptr<PangoContext> _pangoContext;
 	std::optional<ShmBuffer> _bufs;
 	std::vector<Tag> _tags;
-	BarComponent _layoutCmp, _titleCmp, _statusCmp;
-	bool _selected;
+	BarComponent _layoutCmp, _titleCmp;
+	std::vector<StatusBlock> _blocks;
+	// start of the status area
+	int _statusX {0};
+
+	// what was drawn where in the last paint(), sorted by x. index is the
+	// tag or block number.
+	struct ClickTarget {
+		Extent extent;
+		int control;
+		int index;
+	};
+	std::vector<ClickTarget> _clickTargets;
+	bool _selected {false};
 	bool _invalid {false};
+	// hidden by hide(), with the surface and buffers kept for show()
+	bool _hidden {false};
+	// shown again after hide(), the next frame must be presented in full
+	bool _remap {false};
+	// mapped again by show(). no buffer may be attached until the configure
+	// that follows is acked.
+	bool _awaitingConfigure {false};
+
+	// damage of the last paint()
+	Damage _damage;
 
-	// only vaild during render()
+	// only vaild during paint()
 	cairo_t* _painter {nullptr};
-	int _x;
-	ColorScheme _colorScheme;
+	Canvas _canvas;
+	PixelScheme _colorScheme;
 
+	void setupLayerSurface();
 	void layerSurfaceConfigure(uint32_t serial, uint32_t width, uint32_t height);
 	void render();
+	void layoutComponents();
+	void indexClickTargets();
 	void renderTags();
-	void renderStatus();
+	void markDirty();
 
 	// low-level rendering
-	void setColorScheme(const ColorScheme& scheme, bool invert = false);
+	void setColorScheme(const PixelScheme& scheme, bool invert = false);
 	void beginFg();
-	void beginBg();
 	void renderComponent(BarComponent& component);
-	BarComponent createComponent(const std::string& initial = {});
 public:
 	Bar();
 	const wl_surface* surface() const;
 	bool visible() const;
 	void show(wl_output* output);
+	// unmaps the bar but keeps its surface, buffers and last frame, so
+	// show() only needs a commit and a configure
 	void hide();
+	// drops what a hidden bar kept
+	void reclaim();
 	void setTag(int tag, int state, int numClients, int focusedClient);
 	void setSelected(bool selected);
-	void setLayout(const std::string& layout);
-	void setTitle(const std::string& title);
-	void setStatus(const std::string& status);
+	void setLayout(std::string_view layout);
+	void setTitle(std::string_view title);
+	void setStatus(std::string_view status);
+	// empty blocks take no space
+	void setBlock(std::string_view id, std::string_view text);
 	void invalidate();
 	void click(Monitor* mon, int x, int y, int btn);
+	// redraws the changed components into canvas without presenting them.
+	// painter must target the same pixels, it is used for text the glyph
+	// atlas cannot draw. returns the damaged spans.
+	const Damage& paint(cairo_t* painter, const Canvas& canvas);
 };
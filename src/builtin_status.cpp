@@ -0,0 +1,464 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string_view>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <sys/inotify.h>
+#endif
+#include "builtin_status.hpp"
+#include "config.hpp"
+#include "event_loop.hpp"
+
+// reads the whole file from the start, sysfs and procfs regenerate it. the
+// result is NUL-terminated, and empty on error, e.g. ENODEV once the device
+// is gone.
+static std::string_view readFile(int fd, char* buf, size_t size)
+{
+	auto n = pread(fd, buf, size - 1, 0);
+	if (n < 0) {
+		buf[0] = '\0';
+		return {buf, 0};
+	}
+	buf[n] = '\0';
+	return {buf, static_cast<size_t>(n)};
+}
+
+// value of "key: 1234 kB" in /proc/meminfo
+static uint64_t meminfoValue(std::string_view meminfo, std::string_view key)
+{
+	auto pos = meminfo.find(key);
+	if (pos == meminfo.npos) {
+		return 0;
+	}
+	return strtoull(meminfo.data() + pos + key.size(), nullptr, 10);
+}
+
+static int openCloexec(const char* path, int flags = O_RDONLY)
+{
+	return ::open(path, flags | O_CLOEXEC);
+}
+
+bool BuiltinStatus::open(Module& module)
+{
+	auto path = std::string {};
+	switch (module.config.kind) {
+	case StatusClock:
+	case StatusMount:
+		return true;
+	case StatusBattery:
+		path = std::string {"/sys/class/power_supply/"} + module.config.arg;
+		module.fds[0] = openCloexec((path + "/capacity").c_str());
+		module.fds[1] = openCloexec((path + "/status").c_str());
+		break;
+	case StatusCpu:
+		module.fds[0] = openCloexec("/proc/stat");
+		break;
+	case StatusMemory:
+		module.fds[0] = openCloexec("/proc/meminfo");
+		break;
+	case StatusDisk:
+		module.fds[0] = openCloexec(module.config.arg, O_RDONLY | O_DIRECTORY);
+		break;
+	case StatusBacklight:
+		path = std::string {"/sys/class/backlight/"} + module.config.arg;
+		module.fds[0] = openCloexec((path + "/brightness").c_str());
+		module.fds[1] = openCloexec((path + "/max_brightness").c_str());
+		break;
+	case StatusNetwork:
+		path = std::string {"/sys/class/net/"} + module.config.arg + "/operstate";
+		module.fds[0] = openCloexec(path.c_str());
+		break;
+	default:
+		return false;
+	}
+	if (module.fds[0] < 0) {
+		fprintf(stderr, "somebar: status module: ");
+		perror(path.empty() ? module.config.arg : path.c_str());
+		// the second file may have opened
+		if (module.fds[1] >= 0) {
+			close(module.fds[1]);
+			module.fds[1] = -1;
+		}
+		return false;
+	}
+	return true;
+}
+
+static const char* kindName(int kind)
+{
+	switch (kind) {
+	case StatusClock: return "clock";
+	case StatusBattery: return "battery";
+	case StatusCpu: return "cpu";
+	case StatusMemory: return "memory";
+	case StatusDisk: return "disk";
+	case StatusBacklight: return "backlight";
+	case StatusNetwork: return "network";
+	case StatusMount: return "mount";
+	default: return "unknown";
+	}
+}
+
+void BuiltinStatus::start(const std::vector<StatusModule>& config,
+	std::function<void(const std::string& id, const std::string& text)> onChange)
+{
+	using namespace std::chrono;
+	_onChange = std::move(onChange);
+	_modules.reserve(config.size());
+	for (const auto& c : config) {
+		auto id = std::string {kindName(c.kind)};
+		if (c.kind != StatusClock && c.arg) {
+			id = id + ":" + c.arg;
+		}
+		auto& module = _modules.emplace_back(Module {c, id});
+		if (!open(module)) {
+			_modules.pop_back();
+		}
+	}
+	for (auto i = 0u; i < _modules.size(); i++) {
+		auto& module = _modules[i];
+		if (module.config.interval <= 0 || module.config.kind >= StatusBacklight) {
+			if (watchEvents(module)) {
+				update(module);
+			}
+			continue;
+		}
+		update(module);
+		auto tick = [this, i]() {
+			update(_modules[i]);
+		};
+		if (module.config.kind == StatusClock) {
+			module.timer = EventLoop::get().addRealtimeTimer([this, i, tick]() {
+				tick();
+				scheduleClock(_modules[i]);
+			});
+			scheduleClock(module);
+		} else {
+			auto interval = seconds {std::max(module.config.interval, 1)};
+			module.timer = EventLoop::get().addTimer(interval, interval, tick);
+		}
+	}
+}
+
+// the clock wakes up on multiples of its interval in wall-clock time, so a
+// 60 second clock changes when the minute does. the deadline is absolute, and
+// the timer also fires when the time is set, so it follows suspend and NTP.
+void BuiltinStatus::scheduleClock(Module& module)
+{
+	using namespace std::chrono;
+	auto interval = duration_cast<system_clock::duration>(seconds {std::max(module.config.interval, 1)});
+	auto now = system_clock::now();
+	auto next = now - now.time_since_epoch() % interval + interval;
+	EventLoop::get().armTimerAt(module.timer, next);
+}
+
+void BuiltinStatus::update(Module& module)
+{
+	char buf[4096];
+	char out[256];
+	out[0] = '\0';
+	switch (module.config.kind) {
+	case StatusClock: {
+		// round, the timer may fire just before the boundary
+		timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		auto t = static_cast<time_t>(ts.tv_sec + (ts.tv_nsec >= 500000000));
+		tm local;
+		localtime_r(&t, &local);
+		strftime(out, sizeof(out), module.config.arg, &local);
+		break;
+	}
+	case StatusBattery: {
+		auto capacityText = readFile(module.fds[0], buf, sizeof(buf));
+		// the battery was removed, hide the block
+		if (capacityText.empty()) {
+			break;
+		}
+		auto capacity = atoi(capacityText.data());
+		auto charging = module.fds[1] >= 0
+			&& readFile(module.fds[1], buf, sizeof(buf)).substr(0, 8) == "Charging";
+		snprintf(out, sizeof(out), "bat %d%%%s", capacity, charging ? "+" : "");
+		break;
+	}
+	case StatusCpu: {
+		// cpu  user nice system idle iowait irq softirq steal
+		auto stat = readFile(module.fds[0], buf, sizeof(buf));
+		uint64_t v[8] {};
+		if (sscanf(stat.data(), "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64
+			" %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+			&v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) < 4) {
+			break;
+		}
+		auto total = v[0] + v[1] + v[2] + v[3] + v[4] + v[5] + v[6] + v[7];
+		auto busy = total - v[3] - v[4];
+		auto dt = total - module.total;
+		auto percent = module.total && dt ? 100 * (busy - module.busy) / dt : 0;
+		module.busy = busy;
+		module.total = total;
+		snprintf(out, sizeof(out), "cpu %" PRIu64 "%%", percent);
+		break;
+	}
+	case StatusMemory: {
+		auto meminfo = readFile(module.fds[0], buf, sizeof(buf));
+		auto total = meminfoValue(meminfo, "MemTotal:");
+		auto available = meminfoValue(meminfo, "MemAvailable:");
+		snprintf(out, sizeof(out), "mem %.1fG", (total - available) / (1024.0 * 1024.0));
+		break;
+	}
+	case StatusDisk: {
+		struct statvfs fs;
+		if (fstatvfs(module.fds[0], &fs) == 0) {
+			snprintf(out, sizeof(out), "%s %.0fG", module.config.arg,
+				static_cast<double>(fs.f_bavail) * fs.f_frsize / (1024.0 * 1024.0 * 1024.0));
+		}
+		break;
+	}
+	case StatusBacklight: {
+		// an external backlight device was unplugged, hide the block
+		auto brightnessText = readFile(module.fds[0], buf, sizeof(buf));
+		if (brightnessText.empty()) {
+			break;
+		}
+		auto brightness = atol(brightnessText.data());
+		auto maxText = readFile(module.fds[1], buf, sizeof(buf));
+		if (maxText.empty()) {
+			break;
+		}
+		auto max = atol(maxText.data());
+		snprintf(out, sizeof(out), "bl %ld%%", max > 0 ? 100 * brightness / max : 0);
+		break;
+	}
+	case StatusNetwork: {
+		// loopback and tunnel devices report "unknown"
+		auto state = readFile(module.fds[0], buf, sizeof(buf));
+		if (state.substr(0, 2) != "up" && state.substr(0, 7) != "unknown") {
+			snprintf(out, sizeof(out), "%s down", module.config.arg);
+			break;
+		}
+		snprintf(out, sizeof(out), "%s up", module.config.arg);
+		ifaddrs* addrs;
+		if (getifaddrs(&addrs) < 0) {
+			break;
+		}
+		for (auto a = addrs; a; a = a->ifa_next) {
+			if (a->ifa_addr && a->ifa_addr->sa_family == AF_INET && !strcmp(a->ifa_name, module.config.arg)) {
+				// a numeric IPv4 address
+				char host[INET_ADDRSTRLEN];
+				if (getnameinfo(a->ifa_addr, sizeof(sockaddr_in), host, sizeof(host), nullptr, 0, NI_NUMERICHOST) == 0) {
+					snprintf(out, sizeof(out), "%s %s", module.config.arg, host);
+				}
+				break;
+			}
+		}
+		freeifaddrs(addrs);
+		break;
+	}
+	case StatusMount: {
+		// the fifth field of a mountinfo line is the mount point
+		auto field = std::string {" "} + module.config.arg + " ";
+		auto mounted = false;
+		for (auto pos = _mountinfo.find(field); pos != _mountinfo.npos; pos = _mountinfo.find(field, pos + 1)) {
+			auto lineStart = _mountinfo.rfind('\n', pos);
+			lineStart = lineStart == _mountinfo.npos ? 0 : lineStart + 1;
+			auto spaces = std::count(_mountinfo.begin() + lineStart, _mountinfo.begin() + pos + 1, ' ');
+			if (spaces == 4) {
+				mounted = true;
+				break;
+			}
+		}
+		if (mounted) {
+			snprintf(out, sizeof(out), "%s", module.config.arg);
+		}
+		break;
+	}
+	}
+	if (module.text != out) {
+		module.text.assign(out);
+		if (_onChange) {
+			_onChange(module.id, module.text);
+		}
+	}
+}
+
+void BuiltinStatus::updateKind(int kind)
+{
+	for (auto& module : _modules) {
+		if (module.config.kind == kind) {
+			update(module);
+		}
+	}
+}
+
+#ifdef __linux__
+static int openNetlink(int protocol, uint32_t groups)
+{
+	auto fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+	if (fd < 0) {
+		perror("somebar: netlink socket");
+		return -1;
+	}
+	auto addr = sockaddr_nl {};
+	addr.nl_family = AF_NETLINK;
+	addr.nl_groups = groups;
+	if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		perror("somebar: netlink bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// reads all pending datagrams. returns false if there were none.
+template<typename Handler>
+static bool drain(int fd, Handler handler)
+{
+	char buf[8192];
+	auto any = false;
+	ssize_t n;
+	while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+		handler(buf, static_cast<size_t>(n));
+		any = true;
+	}
+	return any;
+}
+
+bool BuiltinStatus::watchEvents(Module& module)
+{
+	auto& loop = EventLoop::get();
+	switch (module.config.kind) {
+	case StatusBattery:
+	case StatusBacklight:
+		if (_ueventFd < 0) {
+			_ueventFd = openNetlink(NETLINK_KOBJECT_UEVENT, 1);
+			if (_ueventFd < 0) {
+				return false;
+			}
+			loop.watch(_ueventFd, EPOLLIN, [this](uint32_t) { onUevent(); });
+		}
+		if (module.config.kind == StatusBacklight) {
+			// writes to brightness from userspace do not send a uevent
+			if (_inotifyFd < 0) {
+				_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+				if (_inotifyFd < 0) {
+					perror("somebar: inotify_init1");
+					return false;
+				}
+				loop.watch(_inotifyFd, EPOLLIN, [this](uint32_t) { onInotify(); });
+			}
+			auto path = std::string {"/sys/class/backlight/"} + module.config.arg + "/brightness";
+			if (inotify_add_watch(_inotifyFd, path.c_str(), IN_MODIFY) < 0) {
+				perror("somebar: inotify_add_watch");
+			}
+		}
+		return true;
+	case StatusNetwork:
+		if (_rtnetlinkFd < 0) {
+			_rtnetlinkFd = openNetlink(NETLINK_ROUTE, RTMGRP_LINK | RTMGRP_IPV4_IFADDR);
+			if (_rtnetlinkFd < 0) {
+				return false;
+			}
+			loop.watch(_rtnetlinkFd, EPOLLIN, [this](uint32_t) { onRtnetlink(); });
+		}
+		return true;
+	case StatusMount:
+		if (_mountinfoFd < 0) {
+			_mountinfoFd = openCloexec("/proc/self/mountinfo");
+			if (_mountinfoFd < 0) {
+				perror("somebar: /proc/self/mountinfo");
+				return false;
+			}
+			// signalled with POLLPRI | POLLERR until the file is read again
+			loop.watch(_mountinfoFd, EPOLLPRI | EPOLLERR, [this](uint32_t) { onMountinfo(); });
+			readMountinfo();
+		}
+		return true;
+	default:
+		fprintf(stderr, "somebar: status module %s has no interval\n", module.config.arg ? module.config.arg : "");
+		return false;
+	}
+}
+
+void BuiltinStatus::onUevent()
+{
+	auto battery = false;
+	auto backlight = false;
+	drain(_ueventFd, [&](const char* buf, size_t size) {
+		// "ACTION@DEVPATH\0KEY=VALUE\0..."
+		for (auto p = buf; p < buf + size; p += strlen(p) + 1) {
+			battery |= !strcmp(p, "SUBSYSTEM=power_supply");
+			backlight |= !strcmp(p, "SUBSYSTEM=backlight");
+		}
+	});
+	if (battery) {
+		updateKind(StatusBattery);
+	}
+	if (backlight) {
+		updateKind(StatusBacklight);
+	}
+}
+
+void BuiltinStatus::onRtnetlink()
+{
+	if (drain(_rtnetlinkFd, [](const char*, size_t) { })) {
+		updateKind(StatusNetwork);
+	}
+}
+
+void BuiltinStatus::onInotify()
+{
+	char buf[4096];
+	auto any = false;
+	while (read(_inotifyFd, buf, sizeof(buf)) > 0) {
+		any = true;
+	}
+	if (any) {
+		updateKind(StatusBacklight);
+	}
+}
+
+void BuiltinStatus::onMountinfo()
+{
+	if (readMountinfo()) {
+		updateKind(StatusMount);
+	}
+}
+#else
+bool BuiltinStatus::watchEvents(Module& module)
+{
+	fprintf(stderr, "somebar: event-driven status modules are only supported on Linux\n");
+	return false;
+}
+void BuiltinStatus::onUevent() { }
+void BuiltinStatus::onRtnetlink() { }
+void BuiltinStatus::onInotify() { }
+void BuiltinStatus::onMountinfo() { }
+#endif
+
+// reads mountinfo to the end, which also clears the pending change
+bool BuiltinStatus::readMountinfo()
+{
+	char buf[4096];
+	auto offset = off_t {0};
+	ssize_t n;
+	_mountinfo.clear();
+	while ((n = pread(_mountinfoFd, buf, sizeof(buf), offset)) > 0) {
+		_mountinfo.append(buf, n);
+		offset += n;
+	}
+	return n == 0;
+}
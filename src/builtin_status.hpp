@@ -0,0 +1,50 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "common.hpp"
+
+// status blocks produced in-process by the modules in config.hpp. files are
+// opened once and re-read with pread. polled modules run on their own timer,
+// the others wake up only when the kernel reports a change: uevents for
+// batteries and backlights, inotify for backlights changed from userspace,
+// rtnetlink for network interfaces, and POLLPRI on mountinfo for mounts.
+class BuiltinStatus {
+	struct Module {
+		StatusModule config;
+		// block id, e.g. "clock" or "disk:/"
+		std::string id;
+		int fds[2] {-1, -1};
+		int timer {-1};
+		std::string text;
+		// cpu: counters of the previous sample
+		uint64_t busy {0};
+		uint64_t total {0};
+	};
+	std::vector<Module> _modules;
+	std::function<void(const std::string& id, const std::string& text)> _onChange;
+	int _ueventFd {-1};
+	int _rtnetlinkFd {-1};
+	int _inotifyFd {-1};
+	int _mountinfoFd {-1};
+	std::string _mountinfo;
+
+	bool open(Module& module);
+	bool watchEvents(Module& module);
+	void update(Module& module);
+	void updateKind(int kind);
+	void scheduleClock(Module& module);
+	void onUevent();
+	void onRtnetlink();
+	void onInotify();
+	void onMountinfo();
+	bool readMountinfo();
+public:
+	// onChange runs whenever the text of a module changes
+	void start(const std::vector<StatusModule>& config,
+		std::function<void(const std::string& id, const std::string& text)> onChange);
+};
@@ -0,0 +1,149 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "capture.hpp"
+
+constexpr std::string_view captureMagic {"SBCAP\0\0\1", 8};
+// the buffer is written out when it grows beyond this
+constexpr size_t captureFlushSize = 64*1024;
+
+static void putVarint(std::string& out, uint64_t value)
+{
+	while (value >= 0x80) {
+		out += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+static bool getVarint(std::string_view data, size_t& pos, uint64_t& value)
+{
+	value = 0;
+	for (auto shift = 0; shift < 64 && pos < data.size(); shift += 7) {
+		auto byte = static_cast<uint8_t>(data[pos++]);
+		value |= uint64_t {byte & 0x7fu} << shift;
+		if (!(byte & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool CaptureWriter::open(const std::string& path)
+{
+	close();
+	_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (_fd < 0) {
+		return false;
+	}
+	_buf.assign(captureMagic);
+	_first = true;
+	return true;
+}
+
+void CaptureWriter::record(CaptureSource source, std::string_view line, uint64_t time)
+{
+	if (_fd < 0) {
+		return;
+	}
+	if (_first) {
+		_last = time;
+		_first = false;
+	}
+	_buf += static_cast<char>(source);
+	putVarint(_buf, time - _last);
+	putVarint(_buf, line.size());
+	_buf += line;
+	_last = time;
+	if (_buf.size() >= captureFlushSize) {
+		writeOut();
+	}
+}
+
+void CaptureWriter::writeOut()
+{
+	auto p = _buf.data();
+	auto left = _buf.size();
+	while (left) {
+		auto n = write(_fd, p, left);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n < 0) {
+			// stop recording rather than leave a gap in the capture
+			perror("somebar: write capture");
+			::close(_fd);
+			_fd = -1;
+			break;
+		}
+		p += n;
+		left -= n;
+	}
+	_buf.clear();
+}
+
+void CaptureWriter::close()
+{
+	if (_fd < 0) {
+		return;
+	}
+	writeOut();
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+bool CaptureReader::open(const std::string& path, std::string& error)
+{
+	auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		error = "cannot open capture";
+		return false;
+	}
+	_data.clear();
+	char buf[64*1024];
+	ssize_t n;
+	while ((n = read(fd, buf, sizeof(buf))) > 0 || (n < 0 && errno == EINTR)) {
+		if (n > 0) {
+			_data.append(buf, n);
+		}
+	}
+	::close(fd);
+	if (n < 0) {
+		error = "cannot read capture";
+		return false;
+	}
+	if (std::string_view {_data}.substr(0, captureMagic.size()) != captureMagic) {
+		error = "not a somebar capture";
+		return false;
+	}
+	_pos = captureMagic.size();
+	_time = 0;
+	return true;
+}
+
+bool CaptureReader::next(CaptureRecord& record)
+{
+	auto data = std::string_view {_data};
+	uint64_t delta, length;
+	if (_pos >= data.size()) {
+		return false;
+	}
+	auto source = static_cast<uint8_t>(data[_pos++]);
+	if (source > static_cast<uint8_t>(CaptureSource::Fifo)
+		|| !getVarint(data, _pos, delta)
+		|| !getVarint(data, _pos, length)
+		|| length > data.size() - _pos) {
+		_pos = data.size();
+		return false;
+	}
+	_time += delta;
+	record = {static_cast<CaptureSource>(source), _time, data.substr(_pos, length)};
+	_pos += length;
+	return true;
+}
@@ -0,0 +1,61 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// captures of the lines somebar reads from stdin and the fifo, to replay real
+// traffic later. a capture starts with the 8 byte magic "SBCAP\0\0\1",
+// followed by one record per line:
+//   source    1 byte, a CaptureSource
+//   time      nanoseconds since the previous record, LEB128
+//   length    LEB128
+//   the line, without the newline
+// lines from the same read() have the same time.
+
+enum class CaptureSource : uint8_t {
+	Stdin,
+	Fifo,
+};
+
+struct CaptureRecord {
+	CaptureSource source;
+	// nanoseconds since the first record
+	uint64_t time;
+	std::string_view line;
+};
+
+class CaptureWriter {
+	int _fd {-1};
+	std::string _buf;
+	uint64_t _last {0};
+	bool _first {true};
+
+	void writeOut();
+public:
+	CaptureWriter() = default;
+	CaptureWriter(const CaptureWriter&) = delete;
+	CaptureWriter& operator=(const CaptureWriter&) = delete;
+	~CaptureWriter() { close(); }
+
+	// returns false and sets errno on failure
+	bool open(const std::string& path);
+	bool isOpen() const { return _fd >= 0; }
+	// time is a monotonic timestamp in nanoseconds
+	void record(CaptureSource source, std::string_view line, uint64_t time);
+	void close();
+};
+
+class CaptureReader {
+	std::string _data;
+	size_t _pos {0};
+	uint64_t _time {0};
+public:
+	// reads the whole capture. returns false and sets error on failure.
+	bool open(const std::string& path, std::string& error);
+	// the line points into the reader. returns false at the end, and on a
+	// truncated record.
+	bool next(CaptureRecord& record);
+};
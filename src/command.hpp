@@ -0,0 +1,128 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <array>
+#include <charconv>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+
+// parses the lines dwl prints in printstatus(), and the commands sent to the
+// status fifo. works on views into the line and never allocates.
+
+enum class Verb {
+	Unknown,
+	// from dwl
+	Title, Selmon, Tags, Layout,
+	// from the status fifo
+	Status, Block, Show, Hide, Toggle, Get, Ring, Stats,
+};
+
+constexpr std::pair<std::string_view, Verb> verbTable[] = {
+	{"title", Verb::Title},
+	{"selmon", Verb::Selmon},
+	{"tags", Verb::Tags},
+	{"layout", Verb::Layout},
+	{"status", Verb::Status},
+	{"block", Verb::Block},
+	{"show", Verb::Show},
+	{"hide", Verb::Hide},
+	{"toggle", Verb::Toggle},
+	{"get", Verb::Get},
+	{"ring", Verb::Ring},
+	{"stats", Verb::Stats},
+};
+
+constexpr Verb parseVerb(std::string_view word)
+{
+	for (const auto& entry : verbTable) {
+		if (entry.first == word) {
+			return entry.second;
+		}
+	}
+	return Verb::Unknown;
+}
+
+struct Command {
+	Verb verb {Verb::Unknown};
+	// dwl only
+	std::string_view monitor;
+	// the rest of the line after the verb. used by title, layout, status,
+	// block, get, ring, and show/hide/toggle, where it names the monitor.
+	std::string_view argument;
+	// selmon: selected. tags: occupied, tags, client tags, urgent
+	std::array<uint32_t, 4> numbers {};
+};
+
+// splits the next space-separated word off line
+constexpr std::string_view nextWord(std::string_view& line)
+{
+	auto end = line.find(' ');
+	auto word = line.substr(0, end);
+	line.remove_prefix(end == line.npos ? line.size() : end+1);
+	return word;
+}
+
+inline bool parseNumbers(std::string_view line, uint32_t* numbers, size_t count)
+{
+	for (auto i = 0u; i < count; i++) {
+		auto word = nextWord(line);
+		auto res = std::from_chars(word.data(), word.data()+word.size(), numbers[i]);
+		if (res.ec != std::errc {} || res.ptr != word.data()+word.size()) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// "<monitor> <verb> <arguments>". verbs newer dwl versions print are
+// accepted as Verb::Unknown.
+inline bool parseDwlCommand(std::string_view line, Command& cmd)
+{
+	cmd.monitor = nextWord(line);
+	auto verb = nextWord(line);
+	if (cmd.monitor.empty() || verb.empty()) {
+		return false;
+	}
+	cmd.verb = parseVerb(verb);
+	cmd.argument = line;
+	switch (cmd.verb) {
+	case Verb::Selmon:
+		return parseNumbers(line, cmd.numbers.data(), 1);
+	case Verb::Tags:
+		return parseNumbers(line, cmd.numbers.data(), 4);
+	case Verb::Status:
+	case Verb::Block:
+	case Verb::Show:
+	case Verb::Hide:
+	case Verb::Toggle:
+	case Verb::Get:
+	case Verb::Ring:
+	case Verb::Stats:
+		return false;
+	default:
+		return true;
+	}
+}
+
+// "<verb> <arguments>"
+inline bool parseControlCommand(std::string_view line, Command& cmd)
+{
+	cmd.monitor = {};
+	cmd.verb = parseVerb(nextWord(line));
+	cmd.argument = line;
+	switch (cmd.verb) {
+	case Verb::Status:
+	case Verb::Block:
+	case Verb::Show:
+	case Verb::Hide:
+	case Verb::Toggle:
+	case Verb::Get:
+	case Verb::Ring:
+	case Verb::Stats:
+		return true;
+	default:
+		return false;
+	}
+}
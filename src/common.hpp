@@ -4,6 +4,7 @@
 #pragma once
 #include <memory>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <wayland-client.h>
 #include <linux/input-event-codes.h>
@@ -34,12 +35,35 @@ struct Button {
 	const Arg arg;
 };
 
+// buttons for a single status block
+struct BlockButton {
+	const char* block;
+	int btn; // <linux/input-event-codes.h>
+	void (*func)(Monitor& mon, const Arg& arg);
+	const Arg arg;
+};
+
+enum StatusKind {
+	StatusClock, StatusBattery, StatusCpu, StatusMemory, StatusDisk,
+	// only updated when the kernel reports a change
+	StatusBacklight, StatusNetwork, StatusMount,
+};
+struct StatusModule {
+	int kind;
+	// clock: strftime format. battery, backlight: device name.
+	// network: interface name. disk, mount: mount point.
+	const char* arg;
+	int interval; // seconds. 0 updates a battery only on kernel events.
+};
+
 extern wl_display* display;
 extern wl_compositor* compositor;
 extern wl_shm* shm;
 extern zwlr_layer_shell_v1* wlrLayerShell;
 
 void spawn(Monitor&, const Arg& arg);
+// reports a click on a status block to its event fifo
+void blockClicked(Monitor& mon, std::string_view block, int btn);
 void setCloexec(int fd);
 [[noreturn]] void die(const char* why);
 [[noreturn]] void diesys(const char* why);
@@ -65,6 +89,5 @@ WL_DELETER(cairo_t, cairo_destroy);
 WL_DELETER(cairo_surface_t, cairo_surface_destroy);
 
 WL_DELETER(PangoContext, g_object_unref);
-WL_DELETER(PangoLayout, g_object_unref);
 
 #undef WL_DELETER
@@ -5,6 +5,9 @@
 #include "common.hpp"
 
 constexpr bool topbar = true;
+// hidden bars keep their surface and buffers for this long, so showing them
+// again is instant. 0 drops them when the bar is hidden.
+constexpr int keepHiddenSeconds = 300;
 
 constexpr int paddingX = 10;
 constexpr int paddingY = 3;
@@ -25,3 +28,22 @@ static std::vector<std::string> tagNames = {
 constexpr Button buttons[] = {
 	{ ClkStatusText,   BTN_RIGHT,  spawn,      {.v = termcmd} },
 };
+
+// run in addition to buttons when the click is on the named status block
+static std::vector<BlockButton> blockButtons = {
+	// { "clock",         BTN_LEFT,   spawn,      {.v = calendarcmd} },
+};
+
+// built-in status modules, each shown as its own status block after the
+// text set with the status command. they read /proc and /sys directly
+// instead of running a status script.
+static std::vector<StatusModule> statusModules = {
+	// { StatusCpu,       nullptr,            5 },
+	// { StatusMemory,    nullptr,            5 },
+	// { StatusDisk,      "/",                60 },
+	// { StatusBattery,   "BAT0",             30 },
+	// { StatusBacklight, "intel_backlight",  0 },
+	// { StatusNetwork,   "wlan0",            0 },
+	// { StatusMount,     "/media/usb",       0 },
+	// { StatusClock,     "%a %d %b %H:%M",   60 },
+};
@@ -0,0 +1,133 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "control_socket.hpp"
+#include "event_loop.hpp"
+
+// longer messages are truncated by the kernel, and rejected
+constexpr size_t maxMessage = 64*1024;
+constexpr size_t maxFds = 4;
+
+bool ControlSocket::listen(const std::string& path, Handler handler)
+{
+	auto addr = sockaddr_un {};
+	addr.sun_family = AF_UNIX;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "somebar: control socket path too long: %s\n", path.c_str());
+		return false;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+
+	_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (_fd < 0) {
+		diesys("socket");
+	}
+	// left behind by a somebar that did not exit cleanly. the fifo next to
+	// it was free, so no running somebar uses it.
+	unlink(path.c_str());
+	if (bind(_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || ::listen(_fd, 16) < 0) {
+		perror("somebar: control socket");
+		::close(_fd);
+		_fd = -1;
+		return false;
+	}
+	_path = path;
+	_handler = std::move(handler);
+	EventLoop::get().watch(_fd, EPOLLIN, [this](uint32_t) { onAccept(); });
+	return true;
+}
+
+void ControlSocket::close()
+{
+	for (auto fd : _clients) {
+		::close(fd);
+	}
+	_clients.clear();
+	if (_fd >= 0) {
+		::close(_fd);
+		unlink(_path.c_str());
+		_fd = -1;
+	}
+}
+
+void ControlSocket::onAccept()
+{
+	int fd;
+	while ((fd = accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+		_clients.push_back(fd);
+		EventLoop::get().watch(fd, EPOLLIN, [this, fd](uint32_t events) { onClient(fd, events); });
+	}
+}
+
+void ControlSocket::onClient(int fd, uint32_t events)
+{
+	static char buf[maxMessage];
+	while (true) {
+		alignas(cmsghdr) char control[CMSG_SPACE(maxFds * sizeof(int))];
+		auto iov = iovec {buf, sizeof(buf)};
+		auto msg = msghdr {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		auto n = recvmsg(fd, &msg, MSG_TRUNC | MSG_CMSG_CLOEXEC);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			if (events & (EPOLLHUP | EPOLLERR)) {
+				disconnect(fd);
+			}
+			return;
+		}
+		if (n <= 0) {
+			disconnect(fd);
+			return;
+		}
+		_reply.clear();
+		_request.client = fd;
+		_request.fds.clear();
+		for (auto cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+			if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+				auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+				auto fds = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+				_request.fds.insert(_request.fds.end(), fds, fds + count);
+			}
+		}
+		auto& request = _request.text;
+		request = std::string_view {buf, std::min(static_cast<size_t>(n), sizeof(buf))};
+		while (!request.empty() && request.back() == '\n') {
+			request.remove_suffix(1);
+		}
+		if (static_cast<size_t>(n) > sizeof(buf) || (msg.msg_flags & MSG_CTRUNC)) {
+			_reply = "error message too long";
+		} else if (!_handler(_request, _reply)) {
+			_reply.insert(0, _reply.empty() ? "error unknown command" : "error ");
+		} else {
+			_reply.insert(0, _reply.empty() ? "ok" : "ok\n");
+		}
+		for (auto passed : _request.fds) {
+			::close(passed);
+		}
+		// a client that does not read its replies is dropped
+		if (send(fd, _reply.data(), _reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT) < 0) {
+			disconnect(fd);
+			return;
+		}
+	}
+}
+
+void ControlSocket::disconnect(int fd)
+{
+	if (onDisconnect) {
+		onDisconnect(fd);
+	}
+	EventLoop::get().unwatch(fd);
+	::close(fd);
+	_clients.erase(std::remove(_clients.begin(), _clients.end(), fd), _clients.end());
+}
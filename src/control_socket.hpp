@@ -0,0 +1,42 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// SOCK_SEQPACKET socket that accepts the same commands as the status fifo.
+// every message is one command, and is answered with one message: "ok",
+// optionally followed by a newline and the result of a query, or
+// "error <reason>". clients can stay connected for as long as they like.
+class ControlSocket {
+public:
+	struct Request {
+		int client;
+		std::string_view text;
+		// received with SCM_RIGHTS. the handler removes the ones it keeps,
+		// the rest are closed.
+		std::vector<int> fds;
+	};
+	using Handler = std::function<bool(Request& request, std::string& reply)>;
+private:
+	int _fd {-1};
+	std::string _path;
+	std::vector<int> _clients;
+	Handler _handler;
+	std::string _reply;
+	Request _request;
+
+	void onAccept();
+	void onClient(int fd, uint32_t events);
+	void disconnect(int fd);
+public:
+	// handler returns false for unknown or malformed commands, and may put
+	// the reason into reply. reply is empty when it is called.
+	bool listen(const std::string& path, Handler handler);
+	void close();
+	// runs when a client disconnects, with its Request::client
+	std::function<void(int client)> onDisconnect;
+};
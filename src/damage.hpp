@@ -0,0 +1,47 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <algorithm>
+#include <vector>
+
+// horizontal span of the bar. everything on the bar spans its full height,
+// so only x coordinates are tracked.
+struct Extent {
+	int x {0};
+	int width {0};
+	int end() const { return x + width; }
+};
+
+// sorted list of disjoint extents
+class Damage {
+	std::vector<Extent> _spans;
+public:
+	void add(Extent e)
+	{
+		if (e.width <= 0) {
+			return;
+		}
+		auto it = std::lower_bound(_spans.begin(), _spans.end(), e.x,
+			[](const Extent& span, int x) { return span.end() < x; });
+		auto last = it;
+		while (last != _spans.end() && last->x <= e.end()) {
+			auto end = std::max(e.end(), last->end());
+			e.x = std::min(e.x, last->x);
+			e.width = end - e.x;
+			last++;
+		}
+		it = _spans.erase(it, last);
+		_spans.insert(it, e);
+	}
+	void add(const Damage& other)
+	{
+		for (auto span : other) {
+			add(span);
+		}
+	}
+	void clear() { _spans.clear(); }
+	bool empty() const { return _spans.empty(); }
+	std::vector<Extent>::const_iterator begin() const { return _spans.begin(); }
+	std::vector<Extent>::const_iterator end() const { return _spans.end(); }
+};
@@ -0,0 +1,219 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include "common.hpp"
+#include "event_loop.hpp"
+
+EventLoop& EventLoop::get()
+{
+	// never destroyed, so fds registered by other singletons stay valid
+	static auto loop = new EventLoop;
+	return *loop;
+}
+
+EventLoop::EventLoop()
+{
+	_epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (_epollFd < 0) {
+		diesys("epoll_create1");
+	}
+}
+
+void EventLoop::watch(int fd, uint32_t events, FdCallback callback)
+{
+	auto ev = epoll_event {};
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+		diesys("epoll_ctl add");
+	}
+	_watches[fd] = std::make_shared<Watch>(Watch {std::move(callback)});
+}
+
+void EventLoop::modify(int fd, uint32_t events)
+{
+	auto ev = epoll_event {};
+	ev.events = events;
+	ev.data.fd = fd;
+	if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, fd, &ev) < 0) {
+		diesys("epoll_ctl mod");
+	}
+}
+
+void EventLoop::unwatch(int fd)
+{
+	if (_watches.erase(fd)) {
+		epoll_ctl(_epollFd, EPOLL_CTL_DEL, fd, nullptr);
+	}
+}
+
+static itimerspec toTimerSpec(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval)
+{
+	using namespace std::chrono;
+	// a zero it_value would disarm the timer
+	delay = std::max(delay, nanoseconds {1});
+	auto spec = itimerspec {};
+	spec.it_value.tv_sec = duration_cast<seconds>(delay).count();
+	spec.it_value.tv_nsec = (delay % seconds {1}).count();
+	spec.it_interval.tv_sec = duration_cast<seconds>(interval).count();
+	spec.it_interval.tv_nsec = (interval % seconds {1}).count();
+	return spec;
+}
+
+// a disarmed timer. reads fail with ECANCELED after the system clock was set,
+// if it was armed with TFD_TIMER_CANCEL_ON_SET.
+static int createTimer(EventLoop& loop, clockid_t clock, std::function<void()> callback)
+{
+	auto fd = timerfd_create(clock, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (fd < 0) {
+		diesys("timerfd_create");
+	}
+	loop.watch(fd, EPOLLIN, [fd, callback = std::move(callback)](uint32_t) {
+		uint64_t expirations;
+		if (read(fd, &expirations, sizeof(expirations)) < 0 && errno != ECANCELED) {
+			// disarmed or re-armed since the wakeup
+			return;
+		}
+		callback();
+	});
+	return fd;
+}
+
+int EventLoop::addTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval, Callback callback)
+{
+	auto fd = createTimer(*this, CLOCK_MONOTONIC, std::move(callback));
+	armTimer(fd, delay, interval);
+	return fd;
+}
+
+int EventLoop::addRealtimeTimer(Callback callback)
+{
+	return createTimer(*this, CLOCK_REALTIME, std::move(callback));
+}
+
+void EventLoop::armTimer(int timer, std::chrono::nanoseconds delay, std::chrono::nanoseconds interval)
+{
+	auto spec = toTimerSpec(delay, interval);
+	if (timerfd_settime(timer, 0, &spec, nullptr) < 0) {
+		diesys("timerfd_settime");
+	}
+}
+
+void EventLoop::armTimerAt(int timer, std::chrono::system_clock::time_point deadline)
+{
+	using namespace std::chrono;
+	auto sinceEpoch = duration_cast<nanoseconds>(deadline.time_since_epoch());
+	auto spec = itimerspec {};
+	spec.it_value.tv_sec = duration_cast<seconds>(sinceEpoch).count();
+	spec.it_value.tv_nsec = (sinceEpoch % seconds {1}).count();
+	int flags = TFD_TIMER_ABSTIME;
+#ifdef TFD_TIMER_CANCEL_ON_SET
+	flags |= TFD_TIMER_CANCEL_ON_SET;
+#endif
+	if (timerfd_settime(timer, flags, &spec, nullptr) < 0) {
+		diesys("timerfd_settime");
+	}
+}
+
+void EventLoop::cancelTimer(int timer)
+{
+	unwatch(timer);
+	close(timer);
+}
+
+void EventLoop::onSignal(int signo, Callback callback)
+{
+	_signals[signo] = std::move(callback);
+	sigset_t mask;
+	sigemptyset(&mask);
+	for (const auto& signal : _signals) {
+		sigaddset(&mask, signal.first);
+	}
+	if (sigprocmask(SIG_BLOCK, &mask, nullptr) < 0) {
+		diesys("sigprocmask");
+	}
+	auto fd = signalfd(_signalFd, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (fd < 0) {
+		diesys("signalfd");
+	}
+	if (_signalFd < 0) {
+		_signalFd = fd;
+		watch(_signalFd, EPOLLIN, [this](uint32_t) { onSignalFd(); });
+	}
+}
+
+void EventLoop::onSignalFd()
+{
+	signalfd_siginfo info;
+	while (read(_signalFd, &info, sizeof(info)) == sizeof(info)) {
+		auto it = _signals.find(info.ssi_signo);
+		if (it != _signals.end()) {
+			it->second();
+		}
+	}
+}
+
+int EventLoop::addIdle(Callback callback)
+{
+	auto id = _nextIdle++;
+	_idle.push_back({id, std::make_shared<Callback>(std::move(callback))});
+	return id;
+}
+
+void EventLoop::removeIdle(int id)
+{
+	// only cleared here, idle callbacks may be running
+	for (auto& idle : _idle) {
+		if (idle.first == id) {
+			idle.second.reset();
+		}
+	}
+}
+
+void EventLoop::run()
+{
+	auto events = std::array<epoll_event, 16> {};
+	while (!_quitting) {
+		for (auto i = 0u; i < _idle.size(); i++) {
+			if (auto callback = _idle[i].second) {
+				(*callback)();
+			}
+		}
+		_idle.erase(std::remove_if(_idle.begin(), _idle.end(),
+			[](const auto& idle) { return !idle.second; }), _idle.end());
+		if (_quitting) {
+			break;
+		}
+
+		auto n = epoll_wait(_epollFd, events.data(), events.size(), -1);
+		if (n < 0) {
+			if (errno != EINTR) {
+				diesys("epoll_wait");
+			}
+			continue;
+		}
+		for (auto i = 0; i < n && !_quitting; i++) {
+			auto it = _watches.find(events[i].data.fd);
+			if (it == _watches.end()) {
+				// removed by an earlier callback
+				continue;
+			}
+			// keep the callback alive if it unwatches itself
+			auto watch = it->second;
+			watch->callback(events[i].events);
+		}
+	}
+}
+
+void EventLoop::quit()
+{
+	_quitting = true;
+}
@@ -0,0 +1,62 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include <sys/epoll.h>
+
+// epoll based reactor. subsystems register fds, timers, signals and idle
+// callbacks here instead of in main(). callbacks may add and remove
+// registrations, including their own, while they run.
+class EventLoop {
+	using Callback = std::function<void()>;
+	using FdCallback = std::function<void(uint32_t events)>;
+	struct Watch {
+		FdCallback callback;
+	};
+
+	int _epollFd {-1};
+	int _signalFd {-1};
+	bool _quitting {false};
+	int _nextIdle {0};
+	std::unordered_map<int, std::shared_ptr<Watch>> _watches;
+	std::unordered_map<int, Callback> _signals;
+	std::vector<std::pair<int, std::shared_ptr<Callback>>> _idle;
+
+	EventLoop();
+	void onSignalFd();
+public:
+	static EventLoop& get();
+
+	// events are EPOLLIN, EPOLLOUT etc. the callback receives the ready set.
+	void watch(int fd, uint32_t events, FdCallback callback);
+	void modify(int fd, uint32_t events);
+	void unwatch(int fd);
+
+	// fires after delay, then every interval unless it is zero. timers stay
+	// registered until cancelled, so a one-shot timer can be re-armed.
+	// returns the timer id.
+	int addTimer(std::chrono::nanoseconds delay, std::chrono::nanoseconds interval, Callback callback);
+	void armTimer(int timer, std::chrono::nanoseconds delay, std::chrono::nanoseconds interval = {});
+	// a disarmed timer on the wall clock, for armTimerAt. it also fires when
+	// the system clock is set, e.g. by NTP or on resume from suspend, so the
+	// callback can re-arm it for the new time.
+	int addRealtimeTimer(Callback callback);
+	void armTimerAt(int timer, std::chrono::system_clock::time_point deadline);
+	void cancelTimer(int timer);
+
+	// blocks signo and delivers it through a signalfd
+	void onSignal(int signo, Callback callback);
+
+	// runs before every wait, after all ready events have been handled.
+	// returns an id for removeIdle.
+	int addIdle(Callback callback);
+	void removeIdle(int id);
+
+	void run();
+	void quit();
+};
@@ -0,0 +1,207 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <cmath>
+#include <pango/pangocairo.h>
+#include "glyph_atlas.hpp"
+
+constexpr int atlasSize = 1024;
+constexpr int subpixelSteps = 4;
+
+bool GlyphAtlas::Key::operator==(const Key& other) const
+{
+	return font == other.font && glyph == other.glyph && subpixel == other.subpixel;
+}
+
+size_t GlyphAtlas::KeyHash::operator()(const Key& key) const
+{
+	auto h = std::hash<const void*> {}(key.font);
+	h = h*31 + key.glyph;
+	return h*31 + key.subpixel;
+}
+
+GlyphAtlas& GlyphAtlas::get()
+{
+	static auto atlas = new GlyphAtlas;
+	return *atlas;
+}
+
+GlyphAtlas::GlyphAtlas()
+	: _pixels(atlasSize*atlasSize)
+{
+}
+
+void GlyphAtlas::reset()
+{
+	_glyphs.clear();
+	_shelfX = 0;
+	_shelfY = 0;
+	_shelfHeight = 0;
+	stats.resets++;
+}
+
+const GlyphAtlas::Glyph* GlyphAtlas::lookup(PangoFont* font, PangoGlyph glyph, int subpixel)
+{
+	auto key = Key {font, glyph, subpixel};
+	auto it = _glyphs.find(key);
+	if (it != _glyphs.end()) {
+		stats.hits++;
+		return &it->second;
+	}
+	stats.misses++;
+	if (std::find(_fonts.begin(), _fonts.end(), font) == _fonts.end()) {
+		// keep the font alive, so its address cannot be reused by another one
+		g_object_ref(font);
+		_fonts.push_back(font);
+	}
+	auto res = rasterize(font, glyph, subpixel);
+	return &_glyphs.emplace(key, res).first->second;
+}
+
+GlyphAtlas::Glyph GlyphAtlas::rasterize(PangoFont* font, PangoGlyph glyph, int subpixel)
+{
+	auto res = Glyph {};
+	auto scaledFont = pango_cairo_font_get_scaled_font(reinterpret_cast<PangoCairoFont*>(font));
+	if (!scaledFont) {
+		res.color = true;
+		return res;
+	}
+	auto offset = static_cast<double>(subpixel) / subpixelSteps;
+	auto cairoGlyph = cairo_glyph_t {glyph, 0, 0};
+	cairo_text_extents_t extents;
+	cairo_scaled_font_glyph_extents(scaledFont, &cairoGlyph, 1, &extents);
+	if (extents.width <= 0 || extents.height <= 0) {
+		return res;
+	}
+	res.left = static_cast<int>(std::floor(extents.x_bearing + offset)) - 1;
+	res.top = static_cast<int>(std::floor(extents.y_bearing)) - 1;
+	res.width = static_cast<int>(std::ceil(extents.x_bearing + offset + extents.width)) + 1 - res.left;
+	res.height = static_cast<int>(std::ceil(extents.y_bearing + extents.height)) + 1 - res.top;
+	if (res.width > atlasSize || res.height > atlasSize) {
+		res.color = true;
+		return res;
+	}
+
+	// rendered in white on ARGB, so color glyphs can be told apart from plain ones
+	auto img = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create(CAIRO_FORMAT_ARGB32, res.width, res.height)};
+	auto painter = wl_unique_ptr<cairo_t> {cairo_create(img.get())};
+	cairo_set_scaled_font(painter.get(), scaledFont);
+	cairo_set_source_rgba(painter.get(), 1, 1, 1, 1);
+	cairoGlyph.x = offset - res.left;
+	cairoGlyph.y = -res.top;
+	cairo_show_glyphs(painter.get(), &cairoGlyph, 1);
+	cairo_surface_flush(img.get());
+	auto data = cairo_image_surface_get_data(img.get());
+	auto stride = cairo_image_surface_get_stride(img.get());
+
+	if (_shelfX + res.width > atlasSize) {
+		_shelfX = 0;
+		_shelfY += _shelfHeight;
+		_shelfHeight = 0;
+	}
+	if (_shelfY + res.height > atlasSize) {
+		reset();
+	}
+	res.x = _shelfX;
+	res.y = _shelfY;
+	_shelfX += res.width;
+	_shelfHeight = std::max(_shelfHeight, res.height);
+
+	for (auto y = 0; y < res.height; y++) {
+		auto src = reinterpret_cast<const uint32_t*>(data + y*stride);
+		auto dst = &_pixels[(res.y + y)*atlasSize + res.x];
+		for (auto x = 0; x < res.width; x++) {
+			auto a = src[x] >> 24;
+			if ((src[x] & 0xff) != a || (src[x] >> 8 & 0xff) != a || (src[x] >> 16 & 0xff) != a) {
+				res.color = true;
+			}
+			dst[x] = a;
+		}
+	}
+	return res;
+}
+
+// src is premultiplied, so it is only scaled by the glyph coverage
+static inline uint32_t blend(uint32_t src, uint32_t dst, uint32_t coverage, uint32_t inverse)
+{
+	auto t = src*coverage + dst*inverse + 128;
+	return (t + (t >> 8)) >> 8;
+}
+
+bool GlyphAtlas::draw(PangoLayout* layout, const Canvas& canvas, int x, int y, Extent clip, uint32_t pixel)
+{
+	auto minX = std::max(clip.x, 0);
+	auto maxX = std::min(clip.end(), canvas.width);
+	// look up everything first, so nothing is drawn if the cairo fallback is needed
+	_placements.clear();
+	auto resets = stats.resets;
+	auto iter = pango_layout_get_iter(layout);
+	do {
+		auto run = pango_layout_iter_get_run_readonly(iter);
+		if (!run) {
+			continue;
+		}
+		PangoRectangle logical;
+		pango_layout_iter_get_run_extents(iter, nullptr, &logical);
+		auto baseline = pango_layout_iter_get_baseline(iter);
+		auto penX = x*PANGO_SCALE + logical.x;
+		auto font = run->item->analysis.font;
+		for (auto i = 0; i < run->glyphs->num_glyphs; i++) {
+			const auto& info = run->glyphs->glyphs[i];
+			auto glyphX = penX + info.geometry.x_offset;
+			penX += info.geometry.width;
+			if (info.glyph == PANGO_GLYPH_EMPTY) {
+				continue;
+			}
+			// skip glyphs outside clip without rasterizing them. the ink may
+			// reach past the advance, by at most about the line height.
+			if (PANGO_PIXELS_CEIL(glyphX + info.geometry.width + logical.height) <= minX
+				|| PANGO_PIXELS_FLOOR(glyphX - logical.height) >= maxX) {
+				continue;
+			}
+			if (info.glyph & PANGO_GLYPH_UNKNOWN_FLAG) {
+				pango_layout_iter_free(iter);
+				return false;
+			}
+			auto pixelX = glyphX >= 0 ? glyphX / PANGO_SCALE : (glyphX - PANGO_SCALE + 1) / PANGO_SCALE;
+			auto subpixel = (glyphX - pixelX*PANGO_SCALE) * subpixelSteps / PANGO_SCALE;
+			auto glyph = lookup(font, info.glyph, subpixel);
+			// the atlas filled up and dropped the glyphs placed so far. the
+			// visible part of this layout may not fit at all, so don't retry.
+			if (glyph->color || resets != stats.resets) {
+				pango_layout_iter_free(iter);
+				return false;
+			}
+			auto pixelY = y + PANGO_PIXELS(baseline + info.geometry.y_offset);
+			_placements.push_back({glyph, pixelX, pixelY});
+		}
+	} while (pango_layout_iter_next_run(iter));
+	pango_layout_iter_free(iter);
+
+	auto alpha = pixel >> 24;
+	for (const auto& p : _placements) {
+		const auto& glyph = *p.glyph;
+		auto x0 = std::max(p.x + glyph.left, minX);
+		auto x1 = std::min(p.x + glyph.left + glyph.width, maxX);
+		auto y0 = std::max(p.y + glyph.top, 0);
+		auto y1 = std::min(p.y + glyph.top + glyph.height, canvas.height);
+		for (auto py = y0; py < y1; py++) {
+			auto mask = &_pixels[(glyph.y + py - p.y - glyph.top)*atlasSize + glyph.x];
+			auto row = reinterpret_cast<uint32_t*>(canvas.data + py*canvas.stride);
+			for (auto px = x0; px < x1; px++) {
+				auto coverage = uint32_t {mask[px - p.x - glyph.left]};
+				if (!coverage) {
+					continue;
+				}
+				auto inverse = 255 - coverage*alpha/255;
+				auto dst = row[px];
+				row[px] = blend(pixel >> 24, dst >> 24, coverage, inverse) << 24
+					| blend(pixel >> 16 & 0xff, dst >> 16 & 0xff, coverage, inverse) << 16
+					| blend(pixel >> 8 & 0xff, dst >> 8 & 0xff, coverage, inverse) << 8
+					| blend(pixel & 0xff, dst & 0xff, coverage, inverse);
+			}
+		}
+	}
+	return true;
+}
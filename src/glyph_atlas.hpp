@@ -0,0 +1,62 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <unordered_map>
+#include <vector>
+#include <pango/pango.h>
+#include "common.hpp"
+#include "damage.hpp"
+#include "raster.hpp"
+
+// alpha masks of rasterized glyphs, keyed by font, glyph and subpixel position.
+// shaped layouts are composited from the atlas straight into the buffer, and
+// cairo only runs to rasterize glyphs that are not in the atlas yet.
+class GlyphAtlas {
+	struct Key {
+		PangoFont* font;
+		PangoGlyph glyph;
+		int subpixel;
+		bool operator==(const Key& other) const;
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+	struct Glyph {
+		int x, y;
+		int width, height;
+		// offset from the pen position
+		int left, top;
+		// color glyphs cannot be drawn from an alpha mask
+		bool color;
+	};
+	struct Placement {
+		const Glyph* glyph;
+		int x, y;
+	};
+
+	std::unordered_map<Key, Glyph, KeyHash> _glyphs;
+	std::vector<PangoFont*> _fonts;
+	std::vector<uint8_t> _pixels;
+	std::vector<Placement> _placements;
+	int _shelfX {0}, _shelfY {0}, _shelfHeight {0};
+
+	GlyphAtlas();
+	const Glyph* lookup(PangoFont* font, PangoGlyph glyph, int subpixel);
+	Glyph rasterize(PangoFont* font, PangoGlyph glyph, int subpixel);
+	void reset();
+public:
+	struct Stats {
+		unsigned long hits;
+		unsigned long misses;
+		unsigned long resets;
+	};
+	Stats stats {};
+
+	static GlyphAtlas& get();
+	// draws the layout in the premultiplied pixel color with its top left
+	// corner at (x, y), clipped to clip. returns false without drawing if the
+	// layout contains glyphs that cannot be drawn from the atlas, or more
+	// visible glyphs than fit into it.
+	bool draw(PangoLayout* layout, const Canvas& canvas, int x, int y, Extent clip, uint32_t pixel);
+};
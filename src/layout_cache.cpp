@@ -0,0 +1,63 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <pango/pangocairo.h>
+#include "layout_cache.hpp"
+
+bool LayoutCache::Key::operator==(const Key& other) const
+{
+	return scale == other.scale
+		&& text == other.text
+		&& (font == other.font || pango_font_description_equal(font, other.font));
+}
+
+size_t LayoutCache::KeyHash::operator()(const Key& key) const
+{
+	auto h = std::hash<std::string> {}(key.text);
+	h = h*31 + pango_font_description_hash(key.font);
+	return h*31 + key.scale;
+}
+
+LayoutCache& LayoutCache::get()
+{
+	// never destroyed, so bars can still drop layouts during static destruction
+	static auto cache = new LayoutCache;
+	return *cache;
+}
+
+PangoContext* LayoutCache::context(int scale)
+{
+	auto& context = _contexts[scale];
+	if (!context) {
+		context.reset(pango_font_map_create_context(pango_cairo_font_map_get_default()));
+		if (!context) {
+			die("pango_font_map_create_context");
+		}
+		// pick up the font options of the image surfaces bars are drawn into
+		auto img = wl_unique_ptr<cairo_surface_t> {cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 1, 1)};
+		auto painter = wl_unique_ptr<cairo_t> {cairo_create(img.get())};
+		cairo_scale(painter.get(), scale, scale);
+		pango_cairo_update_context(painter.get(), context.get());
+	}
+	return context.get();
+}
+
+std::shared_ptr<PangoLayout> LayoutCache::layout(const std::string& text, const PangoFontDescription* font, int scale)
+{
+	auto it = _layouts.try_emplace(Key {text, font, scale}).first;
+	if (auto layout = it->second.lock()) {
+		stats.hits++;
+		return layout;
+	}
+	stats.misses++;
+	auto layout = pango_layout_new(context(scale));
+	pango_layout_set_font_description(layout, font);
+	pango_layout_set_text(layout, text.c_str(), text.size());
+	auto key = &it->first;
+	auto res = std::shared_ptr<PangoLayout> {layout, [this, key](PangoLayout* layout) {
+		_layouts.erase(_layouts.find(*key));
+		g_object_unref(layout);
+	}};
+	it->second = res;
+	return res;
+}
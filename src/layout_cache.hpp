@@ -0,0 +1,41 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <pango/pango.h>
+#include "common.hpp"
+
+// shaped text shared by all bars, keyed by text, font and output scale.
+// layouts are reference-counted and leave the cache when the last
+// component drops them.
+class LayoutCache {
+	struct Key {
+		std::string text;
+		const PangoFontDescription* font;
+		int scale;
+		bool operator==(const Key& other) const;
+	};
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	std::unordered_map<Key, std::weak_ptr<PangoLayout>, KeyHash> _layouts;
+	// one context per output scale
+	std::map<int, wl_unique_ptr<PangoContext>> _contexts;
+
+	LayoutCache() { }
+	PangoContext* context(int scale);
+public:
+	struct Stats {
+		unsigned long hits;
+		unsigned long misses;
+	};
+	Stats stats {};
+
+	static LayoutCache& get();
+	std::shared_ptr<PangoLayout> layout(const std::string& text, const PangoFontDescription* font, int scale);
+};
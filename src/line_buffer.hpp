@@ -2,22 +2,28 @@
 // See LICENSE file for copyright and license details.
 
 #pragma once
-#include <array>
 #include <algorithm>
+#include <cstring>
+#include <vector>
 #include <sys/types.h>
 
 // reads data from Reader, and passes complete lines to Consumer.
-template<size_t BufSize>
+// the buffer grows to fit long lines, up to maxLine bytes. longer lines are
+// discarded. the partial line at the end is only moved to the front once the
+// buffer is full, not after every read.
 class LineBuffer {
-	using Iterator = typename std::array<char, BufSize>::iterator;
-	std::array<char, BufSize> _buffer;
-	Iterator _bufferedTo;
-	Iterator _consumedTo;
+	std::vector<char> _buffer;
+	// start of the first line that has not been consumed
+	size_t _consumedTo {0};
+	// bytes before this have been searched for a newline
+	size_t _scannedTo {0};
+	size_t _bufferedTo {0};
+	size_t _maxLine;
 	bool _discardLine {false};
 public:
-	LineBuffer()
-		: _bufferedTo {_buffer.begin()}
-		, _consumedTo {_buffer.begin()}
+	explicit LineBuffer(size_t maxLine = 64*1024, size_t initialSize = 4096)
+		: _buffer(std::min(initialSize, maxLine))
+		, _maxLine {maxLine}
 	{
 	}
 
@@ -25,47 +31,54 @@ public:
 	ssize_t readLines(const Reader& reader, const Consumer& consumer)
 	{
 		while (true) {
-			auto bytesRead = reader(_bufferedTo, _buffer.end() - _bufferedTo);
+			makeRoom();
+			auto bytesRead = reader(_buffer.data() + _bufferedTo, _buffer.size() - _bufferedTo);
 			if (bytesRead <= 0) {
 				return bytesRead;
 			}
 			_bufferedTo += bytesRead;
 			dispatchLines(consumer);
-			resetBuffer();
 		}
 	}
 private:
 	template<typename Consumer>
 	void dispatchLines(const Consumer& consumer)
 	{
-		while (true) {
-			auto separator = std::find(_consumedTo, _bufferedTo, '\n');
-			if (separator == _bufferedTo) {
-				break;
-			}
-			size_t lineLength = separator - _consumedTo;
+		auto data = _buffer.data();
+		while (auto separator = static_cast<char*>(
+			memchr(data + _scannedTo, '\n', _bufferedTo - _scannedTo))) {
 			if (!_discardLine) {
-				consumer(_consumedTo, lineLength);
+				consumer(data + _consumedTo, separator - (data + _consumedTo));
 			}
-			_consumedTo = separator + 1;
+			_consumedTo = _scannedTo = separator + 1 - data;
 			_discardLine = false;
 		}
+		_scannedTo = _bufferedTo;
+		if (_consumedTo == _bufferedTo) {
+			_consumedTo = _scannedTo = _bufferedTo = 0;
+		}
 	}
 
-	void resetBuffer()
+	void makeRoom()
 	{
-		size_t bytesRemaining = _bufferedTo - _consumedTo;
-		if (bytesRemaining == _buffer.size()) {
+		if (_bufferedTo < _buffer.size()) {
+			return;
+		}
+		auto bytesRemaining = _bufferedTo - _consumedTo;
+		if (bytesRemaining >= _maxLine) {
 			// line too long
 			_discardLine = true;
-			_consumedTo = _buffer.begin();
-			_bufferedTo = _buffer.begin();
-		} else {
-			// move the last partial message to the front of the buffer, so a full-sized
-			// message will fit
-			std::copy(_consumedTo, _bufferedTo, _buffer.begin());
-			_consumedTo = _buffer.begin();
-			_bufferedTo = _consumedTo + bytesRemaining;
+			_consumedTo = _scannedTo = _bufferedTo = 0;
+			return;
+		}
+		if (_consumedTo > 0) {
+			// move the partial line to the front of the buffer
+			memmove(_buffer.data(), _buffer.data() + _consumedTo, bytesRemaining);
+			_consumedTo = 0;
+			_scannedTo = _bufferedTo = bytesRemaining;
+		}
+		if (bytesRemaining > _buffer.size() / 2) {
+			_buffer.resize(std::min(_buffer.size() * 2, _maxLine));
 		}
 	}
 };
@@ -3,17 +3,18 @@
 
 #include <algorithm>
 #include <cstdio>
-#include <sstream>
 #include <list>
 #include <optional>
+#include <string_view>
 #include <utility>
 #include <vector>
 #include <fcntl.h>
-#include <poll.h>
 #include <signal.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/un.h>
 #include <unistd.h>
 #include <linux/input-event-codes.h>
 #include <wayland-client.h>
@@ -24,7 +25,16 @@
 #include "common.hpp"
 #include "config.hpp"
 #include "bar.hpp"
+#include "builtin_status.hpp"
+#include "capture.hpp"
+#include "command.hpp"
+#include "control_socket.hpp"
+#include "event_loop.hpp"
 #include "line_buffer.hpp"
+#include "metrics.hpp"
+#include "state_snapshot.hpp"
+#include "status_rings.hpp"
+#include "trace.hpp"
 
 struct Monitor {
 	uint32_t registryName;
@@ -33,7 +43,9 @@ struct Monitor {
 	Bar bar;
 	bool desiredVisibility {true};
 	bool hasData;
-	uint32_t tags;
+	// last state from dwl, for queries
+	uint32_t occupied, tags, clientTags, urgent;
+	std::string title, layout;
 };
 
 struct SeatPointer {
@@ -51,12 +63,25 @@ struct Seat {
 static Monitor* monitorFromSurface(const wl_surface* surface);
 static void setupMonitor(uint32_t name, wl_output* output);
 static void updatemon(Monitor &mon);
+static void setTags(Monitor& mon, uint32_t occupied, uint32_t tags, uint32_t clientTags, uint32_t urgent);
+static void setSelected(Monitor& mon, bool selected);
+static void saveMonitor(const Monitor& mon);
+static void restoreMonitor(Monitor& mon);
+static void scheduleReclaim();
 static void onReady();
 static void setupStatusFifo();
 static void onStatus();
 static void onStdin();
-static void handleStdin(const std::string& line);
-static void updateVisibility(const std::string& name, bool(*updater)(bool));
+static void handleStdin(std::string_view line);
+static void handleStatus(std::string_view line);
+static void startReplay(const char* path);
+static void replayBatch();
+static bool handleCommand(std::string_view line, std::string& reply,
+	ControlSocket::Request* request = nullptr);
+static bool handleQuery(std::string_view query, std::string& reply);
+static void setStatusBlock(std::string_view id, std::string_view text);
+static void dumpMetrics();
+static void updateVisibility(std::string_view name, bool(*updater)(bool));
 static void onGlobalAdd(void*, wl_registry* registry, uint32_t name, const char* interface, uint32_t version);
 static void onGlobalRemove(void*, wl_registry* registry, uint32_t name);
 static void requireGlobal(const void* p, const char* name);
@@ -76,19 +101,34 @@ static std::list<Monitor> monitors;
 static std::vector<std::pair<uint32_t, wl_output*>> uninitializedOutputs;
 static std::list<Seat> seats;
 static Monitor* selmon;
-static std::string lastStatus;
+// id and text of every status block, in the order they were created
+static std::vector<std::pair<std::string, std::string>> statusBlocks;
+static BuiltinStatus builtinStatus;
 static std::string statusFifoName;
-static std::vector<pollfd> pollfds;
-static std::array<int, 2> signalSelfPipe;
 static int displayFd {-1};
 static int statusFifoFd {-1};
 static int statusFifoWriter {-1};
-static bool quitting {false};
+static int reclaimTimer {-1};
+static ControlSocket controlSocket;
+static StatusRings statusRings;
+static StateSnapshot snapshot;
+static CaptureWriter capture;
+static CaptureReader replay;
+static const char* replayPath;
+static bool replayPaced;
+static std::optional<CaptureRecord> replayRecord;
+static int replayTimer {-1};
+static uint64_t replayStart;
+static unsigned long replayLines;
 
 void spawn(Monitor&, const Arg& arg)
 {
 	if (fork() == 0) {
 		auto argv = static_cast<char* const*>(arg.v);
+		// the event loop blocks the signals it reads through a signalfd
+		sigset_t mask;
+		sigemptyset(&mask);
+		sigprocmask(SIG_SETMASK, &mask, nullptr);
 		setsid();
 		execvp(argv[0], argv);
 		fprintf(stderr, "somebar: execvp %s ", argv[0]);
@@ -97,6 +137,69 @@ void spawn(Monitor&, const Arg& arg)
 	}
 }
 
+// writes "<button> <monitor>" to <status fifo>.<block>, if a status script
+// created that fifo and has it open. buttons are numbered as in X and
+// dwmblocks: 1 left, 2 middle, 3 right, 8 back, 9 forward. other buttons
+// are not reported.
+void blockClicked(Monitor& mon, std::string_view block, int btn)
+{
+	int button;
+	switch (btn) {
+	case BTN_LEFT:
+		button = 1;
+		break;
+	case BTN_MIDDLE:
+		button = 2;
+		break;
+	case BTN_RIGHT:
+		button = 3;
+		break;
+	case BTN_SIDE:
+		button = 8;
+		break;
+	case BTN_EXTRA:
+		button = 9;
+		break;
+	default:
+		return;
+	}
+	if (statusFifoName.empty()) {
+		return;
+	}
+	auto path = statusFifoName + ".";
+	for (auto c : block) {
+		path += c == '/' ? '_' : c;
+	}
+	auto fd = open(path.c_str(), O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd < 0) {
+		return;
+	}
+	auto event = std::to_string(button) + " " + mon.xdgName + "\n";
+	// the script may close the fifo between open() and write(). SIGPIPE is
+	// blocked for the write only, ignoring it would be inherited by spawned
+	// programs.
+	sigset_t pipeMask, oldMask, pending;
+	sigemptyset(&pipeMask);
+	sigaddset(&pipeMask, SIGPIPE);
+	pthread_sigmask(SIG_BLOCK, &pipeMask, &oldMask);
+	sigpending(&pending);
+	auto wasPending = sigismember(&pending, SIGPIPE);
+	auto res = write(fd, event.c_str(), event.size());
+	auto err = errno;
+	if (res < 0 && err == EPIPE && !wasPending) {
+		auto zero = timespec {};
+		sigtimedwait(&pipeMask, nullptr, &zero);
+	}
+	pthread_sigmask(SIG_SETMASK, &oldMask, nullptr);
+	// EAGAIN: the script is not keeping up. EPIPE: it closed the fifo. either
+	// way the click is dropped.
+	if (res < 0 && err != EAGAIN && err != EPIPE) {
+		errno = err;
+		perror("somebar: write block event");
+	}
+	close(fd);
+}
+
 static const struct xdg_wm_base_listener xdgWmBaseListener = {
 	[](void*, xdg_wm_base* sender, uint32_t serial) {
 		xdg_wm_base_pong(sender, serial);
@@ -111,6 +214,7 @@ static const struct zxdg_output_v1_listener xdgOutputListener = {
 		auto& monitor = *static_cast<Monitor*>(mp);
 		monitor.xdgName = name;
 		zxdg_output_v1_destroy(xdgOutput);
+		restoreMonitor(monitor);
 	},
 	.description = [](void*, zxdg_output_v1*, const char*) { },
 };
@@ -190,14 +294,20 @@ static const struct wl_seat_listener seatListener = {
 };
 
 void setupMonitor(uint32_t name, wl_output* output) {
-	auto& monitor = monitors.emplace_back(Monitor {name, {}, wl_unique_ptr<wl_output> {output}});
-	monitor.bar.setStatus(lastStatus);
+	// built in place, bars are not movable
+	auto& monitor = monitors.emplace_back();
+	monitor.registryName = name;
+	monitor.wlOutput.reset(output);
+	for (const auto& block : statusBlocks) {
+		monitor.bar.setBlock(block.first, block.second);
+	}
 	auto xdgOutput = zxdg_output_manager_v1_get_xdg_output(xdgOutputManager, monitor.wlOutput.get());
 	zxdg_output_v1_add_listener(xdgOutput, &xdgOutputListener, &monitor);
 }
 
 void updatemon(Monitor& mon)
 {
+	auto trace = TraceSpan {"updatemon"};
 	if (!mon.hasData) {
 		return;
 	}
@@ -209,9 +319,28 @@ void updatemon(Monitor& mon)
 		}
 	} else if (mon.bar.visible()) {
 		mon.bar.hide();
+		scheduleReclaim();
 	}
 }
 
+// drops the surfaces and buffers of bars that are still hidden after
+// keepHiddenSeconds. hiding another bar restarts the countdown.
+void scheduleReclaim()
+{
+	auto delay = std::chrono::seconds {keepHiddenSeconds};
+	if (reclaimTimer >= 0) {
+		EventLoop::get().armTimer(reclaimTimer, delay);
+		return;
+	}
+	reclaimTimer = EventLoop::get().addTimer(delay, {}, []() {
+		for (auto& mon : monitors) {
+			if (!mon.desiredVisibility) {
+				mon.bar.reclaim();
+			}
+		}
+	});
+}
+
 // called after we have received the initial batch of globals
 void onReady()
 {
@@ -246,10 +375,12 @@ bool createFifo(std::string path)
 		}
 		statusFifoWriter = fd;
 
-		pollfds.push_back({
-			.fd = statusFifoFd,
-			.events = POLLIN,
+		EventLoop::get().watch(statusFifoFd, EPOLLIN, [](uint32_t) { onStatus(); });
+		controlSocket.listen(path + ".sock", [](ControlSocket::Request& request, std::string& reply) {
+			return handleCommand(request.text, reply, &request);
 		});
+		controlSocket.onDisconnect = [](int client) { statusRings.detach(client); };
+		statusRings.onRecord = setStatusBlock;
 		return true;
 	} else if (errno != EEXIST) {
 		diesys("mkfifo");
@@ -273,99 +404,365 @@ void setupStatusFifo()
 	}
 }
 
-static LineBuffer<512> stdinBuffer;
+static LineBuffer stdinBuffer;
 static void onStdin()
 {
+	auto trace = TraceSpan {"onStdin"};
+	auto readTime = uint64_t {0};
 	auto res = stdinBuffer.readLines(
-		[](void* p, size_t size) { return read(0, p, size); },
-		[](char* p, size_t size) { handleStdin({p, size}); });
+		[&](void* p, size_t size) {
+			auto trace = TraceSpan {"read stdin"};
+			auto n = read(0, p, size);
+			if (n > 0) {
+				metrics.stdinReads.add(n);
+				readTime = capture.isOpen() ? nowNs() : 0;
+			}
+			return n;
+		},
+		[&](char* p, size_t size) {
+			metrics.stdinLines++;
+			capture.record(CaptureSource::Stdin, {p, size}, readTime);
+			handleStdin({p, size});
+		});
 	if (res == 0) {
-		quitting = true;
+		EventLoop::get().quit();
 	}
 }
 
-static void handleStdin(const std::string& line)
+static void handleStdin(std::string_view line)
 {
 	// this parses the lines that dwl sends in printstatus()
-	std::string monName, command;
-	auto stream = std::istringstream {line};
-	stream >> monName >> command;
-	if (!stream.good()) {
+	auto trace = TraceSpan {"handleStdin"};
+	Command cmd;
+	if (!parseDwlCommand(line, cmd)) {
 		return;
 	}
 	auto mon = std::find_if(begin(monitors), end(monitors), [&](const Monitor& mon) {
-		return mon.xdgName == monName;
+		return mon.xdgName == cmd.monitor;
 	});
 	if (mon == end(monitors))
 		return;
-	if (command == "title") {
-		auto title = std::string {};
- 		std::getline(stream, title);
-		mon->bar.setTitle(title);
-	} else if (command == "selmon") {
-		uint32_t selected;
-		stream >> selected;
-		mon->bar.setSelected(selected);
-		if (selected) {
-			selmon = &*mon;
-		} else if (selmon == &*mon) {
-			selmon = nullptr;
-		}
-	} else if (command == "tags") {
-		uint32_t occupied, tags, clientTags, urgent;
-		stream >> occupied >> tags >> clientTags >> urgent;
-		for (auto i=0u; i<tagNames.size(); i++) {
-			auto tagMask = 1 << i;
-			int state = TagState::None;
-			if (tags & tagMask)
-				state |= TagState::Active;
-			if (urgent & tagMask)
-				state |= TagState::Urgent;
-			mon->bar.setTag(i, state, occupied & tagMask ? 1 : 0, clientTags & tagMask ? 0 : -1);
-		}
-		mon->tags = tags;
-	} else if (command == "layout") {
-		auto layout = std::string {};
-		std::getline(stream, layout);
-		mon->bar.setLayout(layout);
+	switch (cmd.verb) {
+	case Verb::Title:
+		mon->bar.setTitle(cmd.argument);
+		mon->title.assign(cmd.argument);
+		break;
+	case Verb::Selmon:
+		setSelected(*mon, cmd.numbers[0]);
+		break;
+	case Verb::Tags: {
+		auto [occupied, tags, clientTags, urgent] = cmd.numbers;
+		setTags(*mon, occupied, tags, clientTags, urgent);
+		break;
+	}
+	case Verb::Layout:
+		mon->bar.setLayout(cmd.argument);
+		mon->layout.assign(cmd.argument);
+		break;
+	default:
+		break;
 	}
 	mon->hasData = true;
 	updatemon(*mon);
+	saveMonitor(*mon);
+}
+
+void setTags(Monitor& mon, uint32_t occupied, uint32_t tags, uint32_t clientTags, uint32_t urgent)
+{
+	for (auto i=0u; i<tagNames.size(); i++) {
+		auto tagMask = 1 << i;
+		int state = TagState::None;
+		if (tags & tagMask)
+			state |= TagState::Active;
+		if (urgent & tagMask)
+			state |= TagState::Urgent;
+		mon.bar.setTag(i, state, occupied & tagMask ? 1 : 0, clientTags & tagMask ? 0 : -1);
+	}
+	mon.occupied = occupied;
+	mon.tags = tags;
+	mon.clientTags = clientTags;
+	mon.urgent = urgent;
+}
+
+void setSelected(Monitor& mon, bool selected)
+{
+	mon.bar.setSelected(selected);
+	if (selected) {
+		selmon = &mon;
+	} else if (selmon == &mon) {
+		selmon = nullptr;
+	}
+}
+
+void saveMonitor(const Monitor& mon)
+{
+	auto saved = snapshot.monitor(mon.xdgName);
+	if (!saved) {
+		return;
+	}
+	saved->occupied = mon.occupied;
+	saved->tags = mon.tags;
+	saved->clientTags = mon.clientTags;
+	saved->urgent = mon.urgent;
+	saved->selected = selmon == &mon;
+	saved->visible = mon.desiredVisibility;
+	saved->layout.assign(mon.layout);
+	saved->title.assign(mon.title);
+}
+
+// shows what the previous somebar last drew on this output, until dwl sends
+// the current state
+void restoreMonitor(Monitor& mon)
+{
+	auto saved = snapshot.findMonitor(mon.xdgName);
+	if (!saved || mon.hasData) {
+		return;
+	}
+	setTags(mon, saved->occupied, saved->tags, saved->clientTags, saved->urgent);
+	setSelected(mon, saved->selected);
+	mon.layout.assign(saved->layout.view());
+	mon.bar.setLayout(mon.layout);
+	mon.title.assign(saved->title.view());
+	mon.bar.setTitle(mon.title);
+	mon.desiredVisibility = saved->visible;
+	mon.hasData = true;
+	updatemon(mon);
 }
 
-const std::string prefixStatus = "status ";
-const std::string prefixShow = "show ";
-const std::string prefixHide = "hide ";
-const std::string prefixToggle = "toggle ";
-const std::string argAll = "all";
-const std::string argSelected = "selected";
+constexpr std::string_view argAll = "all";
+constexpr std::string_view argSelected = "selected";
 
-static LineBuffer<512> statusBuffer;
+static LineBuffer statusBuffer;
 void onStatus()
 {
+	auto trace = TraceSpan {"onStatus"};
+	auto readTime = uint64_t {0};
 	statusBuffer.readLines(
-	[](void* p, size_t size) {
-		return read(statusFifoFd, p, size);
+	[&](void* p, size_t size) {
+		auto n = read(statusFifoFd, p, size);
+		if (n > 0) {
+			metrics.fifoReads.add(n);
+			readTime = capture.isOpen() ? nowNs() : 0;
+		}
+		return n;
 	},
-	[](const char* buffer, size_t n) {
-		auto str = std::string {buffer, n};
-		if (str.rfind(prefixStatus, 0) == 0) {
-			lastStatus = str.substr(prefixStatus.size());
-			for (auto &monitor : monitors) {
-				monitor.bar.setStatus(lastStatus);
-				monitor.bar.invalidate();
+	[&](const char* buffer, size_t n) {
+		metrics.fifoLines++;
+		capture.record(CaptureSource::Fifo, {buffer, n}, readTime);
+		handleStatus({buffer, n});
+	});
+}
+
+void handleStatus(std::string_view line)
+{
+	// nobody reads replies from the fifo
+	static std::string reply;
+	reply.clear();
+	handleCommand(line, reply);
+}
+
+void startReplay(const char* path)
+{
+	auto error = std::string {};
+	if (!replay.open(path, error)) {
+		fprintf(stderr, "somebar: %s: %s\n", path, error.c_str());
+		cleanup();
+		exit(1);
+	}
+	if (CaptureRecord record; replay.next(record)) {
+		replayRecord = record;
+	}
+	replayStart = nowNs();
+	replayTimer = EventLoop::get().addTimer(std::chrono::nanoseconds {1}, {}, replayBatch);
+}
+
+// feeds the lines that were read together, then waits for the next read, or
+// only for the next loop iteration when replaying as fast as possible
+void replayBatch()
+{
+	auto trace = TraceSpan {"replayBatch"};
+	if (replayRecord) {
+		auto time = replayRecord->time;
+		do {
+			replayLines++;
+			if (replayRecord->source == CaptureSource::Stdin) {
+				metrics.stdinLines++;
+				handleStdin(replayRecord->line);
+			} else {
+				metrics.fifoLines++;
+				handleStatus(replayRecord->line);
 			}
-		} else if (str.rfind(prefixShow, 0) == 0) {
-			updateVisibility(str.substr(prefixShow.size()), [](bool) { return true; });
-		} else if (str.rfind(prefixHide, 0) == 0) {
-			updateVisibility(str.substr(prefixHide.size()), [](bool) { return false; });
-		} else if (str.rfind(prefixToggle, 0) == 0) {
-			updateVisibility(str.substr(prefixToggle.size()), [](bool vis) { return !vis; });
+			if (CaptureRecord record; replay.next(record)) {
+				replayRecord = record;
+			} else {
+				replayRecord.reset();
+			}
+		} while (replayRecord && replayRecord->time == time);
+	}
+	if (!replayRecord) {
+		auto elapsed = nowNs() - replayStart;
+		fprintf(stderr, "somebar: replayed %lu lines in %.3f ms\n", replayLines, elapsed / 1e6);
+		dumpMetrics();
+		EventLoop::get().quit();
+		return;
+	}
+	auto delay = uint64_t {1};
+	if (replayPaced) {
+		auto due = replayStart + replayRecord->time;
+		auto now = nowNs();
+		delay = due > now ? due - now : 1;
+	}
+	EventLoop::get().armTimer(replayTimer, std::chrono::nanoseconds {delay});
+}
+
+// request is set for commands from the control socket
+bool handleCommand(std::string_view line, std::string& reply, ControlSocket::Request* request)
+{
+	auto trace = TraceSpan {"handleCommand"};
+	Command cmd;
+	if (!parseControlCommand(line, cmd)) {
+		return false;
+	}
+	switch (cmd.verb) {
+	case Verb::Status:
+		setStatusBlock(statusBlockId, cmd.argument);
+		break;
+	case Verb::Block: {
+		auto text = cmd.argument;
+		auto id = nextWord(text);
+		if (!id.empty()) {
+			setStatusBlock(id, text);
 		}
-	});
+		break;
+	}
+	case Verb::Show:
+		updateVisibility(cmd.argument, [](bool) { return true; });
+		break;
+	case Verb::Hide:
+		updateVisibility(cmd.argument, [](bool) { return false; });
+		break;
+	case Verb::Toggle:
+		updateVisibility(cmd.argument, [](bool vis) { return !vis; });
+		break;
+	case Verb::Get:
+		return handleQuery(cmd.argument, reply);
+	case Verb::Stats:
+		dumpMetrics();
+		reply = metrics.dump();
+		reply.pop_back();
+		break;
+	case Verb::Ring: {
+		// "ring BLOCK" with the memfd and eventfd of the ring
+		if (!request || request->fds.size() != 2 || cmd.argument.empty()) {
+			reply = "ring needs a block name, a memfd and an eventfd";
+			return false;
+		}
+		if (!statusRings.attach(request->client, cmd.argument, request->fds[0], request->fds[1], reply)) {
+			return false;
+		}
+		// the memfd is mapped, and the eventfd now belongs to statusRings
+		request->fds.pop_back();
+		break;
+	}
+	default:
+		break;
+	}
+	return true;
+}
+
+static Monitor* findMonitor(std::string_view name)
+{
+	if (name.empty() || name == argSelected) {
+		return selmon;
+	}
+	for (auto& mon : monitors) {
+		if (mon.xdgName == name) {
+			return &mon;
+		}
+	}
+	return nullptr;
+}
+
+// "get monitors", "get status", "get stats", or "get tags|title|layout
+// [MONITOR]", where MONITOR defaults to the selected monitor
+bool handleQuery(std::string_view query, std::string& reply)
+{
+	auto what = nextWord(query);
+	auto line = [&](auto&&... parts) {
+		((reply += parts), ...);
+		reply += '\n';
+	};
+	if (what == "monitors") {
+		for (const auto& mon : monitors) {
+			line(mon.xdgName, mon.bar.visible() ? " visible" : " hidden", &mon == selmon ? " selected" : "");
+		}
+	} else if (what == "status") {
+		for (const auto& block : statusBlocks) {
+			line(block.first, " ", block.second);
+		}
+	} else if (what == "stats") {
+		reply = metrics.dump();
+	} else if (what == "tags" || what == "title" || what == "layout") {
+		auto mon = findMonitor(query);
+		if (!mon) {
+			reply = "no such monitor";
+			return false;
+		}
+		if (what == "tags") {
+			// in the order dwl prints them
+			line(std::to_string(mon->occupied), " ", std::to_string(mon->tags), " ",
+				std::to_string(mon->clientTags), " ", std::to_string(mon->urgent));
+		} else {
+			line(what == "title" ? mon->title : mon->layout);
+		}
+	} else {
+		reply = "unknown query";
+		return false;
+	}
+	if (!reply.empty()) {
+		reply.pop_back();
+	}
+	return true;
+}
+
+// writes the metrics to <fifo>.stats, replacing the previous dump
+void dumpMetrics()
+{
+	if (statusFifoName.empty()) {
+		return;
+	}
+	auto path = statusFifoName + ".stats";
+	auto tmp = path + ".tmp";
+	auto fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		perror("somebar: open stats");
+		return;
+	}
+	auto text = metrics.dump();
+	auto ok = write(fd, text.c_str(), text.size()) == static_cast<ssize_t>(text.size());
+	close(fd);
+	if (!ok || rename(tmp.c_str(), path.c_str()) < 0) {
+		perror("somebar: write stats");
+		unlink(tmp.c_str());
+	}
 }
 
-void updateVisibility(const std::string& name, bool(*updater)(bool))
+void setStatusBlock(std::string_view id, std::string_view text)
+{
+	auto block = std::find_if(begin(statusBlocks), end(statusBlocks),
+		[&](const auto& block) { return block.first == id; });
+	if (block == end(statusBlocks)) {
+		block = statusBlocks.insert(end(statusBlocks), {std::string {id}, {}});
+	}
+	block->second.assign(text);
+	snapshot.setBlock(id, text);
+	for (auto &monitor : monitors) {
+		monitor.bar.setBlock(id, text);
+		monitor.bar.invalidate();
+	}
+}
+
+void updateVisibility(std::string_view name, bool(*updater)(bool))
 {
 	auto isCurrent = name == argSelected;
 	auto isAll = name == argAll;
@@ -377,11 +774,110 @@ void updateVisibility(const std::string& name, bool(*updater)(bool))
 			if (newVisibility != mon.desiredVisibility) {
 				mon.desiredVisibility = newVisibility;
 				updatemon(mon);
+				saveMonitor(mon);
 			}
 		}
 	}
 }
 
+// returns -1 if there is no control socket, e.g. with an older somebar
+static int connectControlSocket()
+{
+	auto addr = sockaddr_un {};
+	addr.sun_family = AF_UNIX;
+	auto path = statusFifoName + ".sock";
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+	auto fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+	if (fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// sends one command and prints the result of queries. returns false if
+// somebar rejected the command.
+static bool sendCommand(int fd, std::string_view command)
+{
+	static char reply[64*1024];
+	ssize_t n;
+	if (send(fd, command.data(), command.size(), MSG_NOSIGNAL) < 0 || (n = recv(fd, reply, sizeof(reply), 0)) <= 0) {
+		// not diesys, cleanup() would remove the fifo of the running somebar
+		perror("control socket");
+		exit(1);
+	}
+	auto res = std::string_view {reply, static_cast<size_t>(n)};
+	if (res.substr(0, 2) != "ok") {
+		fprintf(stderr, "somebar: %.*s: %.*s\n", static_cast<int>(res.size()), res.data(),
+			static_cast<int>(command.size()), command.data());
+		return false;
+	}
+	if (res.size() > 3) {
+		printf("%.*s\n", static_cast<int>(res.size() - 3), res.data() + 3);
+	}
+	return true;
+}
+
+static void writeFifo(std::string_view command)
+{
+	auto line = std::string {command} + "\n";
+	if (write(statusFifoWriter, line.c_str(), line.size()) < 0) {
+		perror("write");
+		exit(1);
+	}
+}
+
+// somebar -c: sends the command in argv[optind..], or with "-c -" every line
+// of stdin, over the control socket. falls back to the fifo if there is no
+// socket. never touches fonts, cairo or wayland.
+[[noreturn]] static void runClient(int argc, char* argv[])
+{
+	if (statusFifoName.empty()) {
+		statusFifoName = std::string {getenv("XDG_RUNTIME_DIR")} + "/somebar-0";
+	}
+	auto socketFd = connectControlSocket();
+	if (socketFd < 0) {
+		statusFifoWriter = open(statusFifoName.c_str(), O_WRONLY | O_CLOEXEC);
+		if (statusFifoWriter < 0) {
+			fprintf(stderr, "could not open %s: ", statusFifoName.c_str());
+			perror("");
+			exit(1);
+		}
+		// report a somebar that went away instead of dying from SIGPIPE
+		signal(SIGPIPE, SIG_IGN);
+	}
+	auto forward = [&](std::string_view command) {
+		if (socketFd < 0) {
+			writeFifo(command);
+			return true;
+		}
+		return sendCommand(socketFd, command);
+	};
+
+	if (argc - optind == 1 && !strcmp(argv[optind], "-")) {
+		auto ok = true;
+		auto input = LineBuffer {};
+		input.readLines(
+			[](char* p, size_t size) { return read(STDIN_FILENO, p, size); },
+			[&](const char* p, size_t size) {
+				if (size) {
+					ok &= forward({p, size});
+				}
+			});
+		exit(ok ? 0 : 1);
+	}
+
+	auto str = std::string {};
+	for (auto i = optind; i<argc; i++) {
+		if (i > optind) str += " ";
+		str += argv[i];
+	}
+	exit(forward(str) ? 0 : 1);
+}
+
 struct HandleGlobalHelper {
 	wl_registry* registry;
 	uint32_t name;
@@ -433,18 +929,41 @@ static const struct wl_registry_listener registry_listener = {
 
 int main(int argc, char* argv[])
 {
+	metrics.startTime = nowNs();
 	int opt;
-	while ((opt = getopt(argc, argv, "chvs:")) != -1) {
+	while ((opt = getopt(argc, argv, "chvPs:t:r:R:")) != -1) {
 		switch (opt) {
 			case 's':
 				statusFifoName = optarg;
 				break;
+			case 't':
+				tracer.start(optarg);
+				break;
+			case 'r':
+				if (!capture.open(optarg)) {
+					perror(optarg);
+					exit(1);
+				}
+				break;
+			case 'R':
+				replayPath = optarg;
+				break;
+			case 'P':
+				replayPaced = true;
+				break;
 			case 'h':
-				printf("Usage: %s [-h] [-v] [-s path to the fifo] [-c command]\n", argv[0]);
+				printf("Usage: %s [-h] [-v] [-s path to the fifo] [-t trace file] [-r capture] [-R capture [-P]]\n"
+					"       [-c command]\n", argv[0]);
 				printf("  -h: Show this help\n");
 				printf("  -v: Show somebar version\n");
 				printf("  -s: Change path to the fifo (default is \"$XDG_RUNTIME_DIR/somebar-0\")\n");
+				printf("  -t: Records a trace of the event loop, written on exit and on SIGUSR2\n");
+				printf("      (also enabled by $SOMEBAR_TRACE)\n");
+				printf("  -r: Records the lines read from stdin and the fifo to a capture file\n");
+				printf("  -R: Replays a capture instead of reading stdin, as fast as possible, and exits\n");
+				printf("  -P: With -R, replays at the pace the capture was recorded at\n");
 				printf("  -c: Sends a command to sombar. See README for details.\n");
+				printf("      With -c -, sends every line of stdin as a command.\n");
 				printf("If any of these are specified (except -s), somebar exits after the action.\n");
 				printf("Otherwise, somebar will display itself.\n");
 				exit(0);
@@ -455,44 +974,20 @@ int main(int argc, char* argv[])
 				if (optind >= argc) {
 					die("Expected command");
 				}
-				if (statusFifoName.empty()) {
-					statusFifoName = std::string {getenv("XDG_RUNTIME_DIR")} + "/somebar-0";
-				}
-				statusFifoWriter = open(statusFifoName.c_str(), O_WRONLY | O_CLOEXEC);
-				if (statusFifoWriter < 0) {
-					fprintf(stderr, "could not open %s: ", statusFifoName.c_str());
-					perror("");
-					exit(1);
-				}
-				auto str = std::string {};
-				for (auto i = optind; i<argc; i++) {
-					if (i > optind) str += " ";
-					str += argv[i];
-				}
-				str += "\n";
-				write(statusFifoWriter, str.c_str(), str.size());
-				exit(0);
+				runClient(argc, argv);
 		}
 	}
-	
-	if (pipe(signalSelfPipe.data()) < 0) {
-		diesys("pipe");
-	}
-	setCloexec(signalSelfPipe[0]);
-	setCloexec(signalSelfPipe[1]);
-
-	struct sigaction sighandler = {};
-	sighandler.sa_handler = [](int) {
-		if (write(signalSelfPipe[1], "0", 1) < 0) {
-			diesys("write");
-		}
-	};
-	if (sigaction(SIGTERM, &sighandler, nullptr) < 0) {
-		diesys("sigaction");
-	}
-	if (sigaction(SIGINT, &sighandler, nullptr) < 0) {
-		diesys("sigaction");
+	if (auto path = getenv("SOMEBAR_TRACE"); path && *path && !tracer.enabled) {
+		tracer.start(path);
 	}
+	
+	auto& loop = EventLoop::get();
+	loop.onSignal(SIGTERM, []() { EventLoop::get().quit(); });
+	loop.onSignal(SIGINT, []() { EventLoop::get().quit(); });
+	loop.onSignal(SIGUSR1, dumpMetrics);
+	loop.onSignal(SIGUSR2, []() { tracer.flush(); });
+	// after the signals are blocked, so they are not delivered to the thread
+	preloadFont();
 
 	struct sigaction chld_handler = {};
 	chld_handler.sa_handler = SIG_IGN;
@@ -500,64 +995,55 @@ int main(int argc, char* argv[])
 		die("sigaction");
 	}
 
-	pollfds.push_back({
-		.fd = signalSelfPipe[0],
-		.events = POLLIN,
-	});
-
 	display = wl_display_connect(nullptr);
 	if (!display) {
 		die("Failed to connect to Wayland display");
 	}
 	displayFd = wl_display_get_fd(display);
+	metrics.startupPhase(metrics.startup.connected);
+
+	// a sibling of the fifo, but not named after somebar-N: after a crash the
+	// old fifo is left behind and the next somebar picks another number
+	auto snapshotPath = statusFifoName.empty()
+		? std::string {getenv("XDG_RUNTIME_DIR")} + "/somebar.state"
+		: statusFifoName + ".state";
+	if (snapshot.open(snapshotPath)) {
+		snapshot.forEachBlock(setStatusBlock);
+	}
 
 	auto registry = wl_display_get_registry(display);
 	wl_registry_add_listener(registry, &registry_listener, nullptr);
 	wl_display_roundtrip(display);
+	metrics.startupPhase(metrics.startup.globals);
 	onReady();
+	metrics.startupPhase(metrics.startup.outputs);
 
-	pollfds.push_back({
-		.fd = displayFd,
-		.events = POLLIN,
-	});
-	pollfds.push_back({
-		.fd = STDIN_FILENO,
-		.events = POLLIN,
-	});
-	if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) < 0) {
-		diesys("fcntl F_SETFL");
-	}
-
-	while (!quitting) {
-		waylandFlush();
-		if (poll(pollfds.data(), pollfds.size(), -1) < 0) {
-			if (errno != EINTR) {
-				diesys("poll");
-			}
-		} else {
-			for (auto& ev : pollfds) {
-				if (ev.revents & POLLNVAL) {
-					die("poll revents contains POLLNVAL");
-				} else if (ev.fd == displayFd) {
-					if (ev.revents & POLLIN) {
-						if (wl_display_dispatch(display) < 0) {
-							die("wl_display_dispatch");
-						}
-					}
-					if (ev.revents & POLLOUT) {
-						ev.events = POLLIN;
-						waylandFlush();
-					}
-				} else if (ev.fd == STDIN_FILENO && (ev.revents & POLLIN)) {
-					onStdin();
-				} else if (ev.fd == statusFifoFd && (ev.revents & POLLIN)) {
-					onStatus();
-				} else if (ev.fd == signalSelfPipe[0] && (ev.revents & POLLIN)) {
-					quitting = true;
-				}
+	loop.watch(displayFd, EPOLLIN, [](uint32_t events) {
+		if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+			auto trace = TraceSpan {"wl_display_dispatch"};
+			if (wl_display_dispatch(display) < 0) {
+				die("wl_display_dispatch");
 			}
 		}
+		if (events & EPOLLOUT) {
+			EventLoop::get().modify(displayFd, EPOLLIN);
+			waylandFlush();
+		}
+	});
+	if (replayPath) {
+		startReplay(replayPath);
+	} else {
+		loop.watch(STDIN_FILENO, EPOLLIN, [](uint32_t) { onStdin(); });
+		if (fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK) < 0) {
+			diesys("fcntl F_SETFL");
+		}
 	}
+	loop.addIdle(waylandFlush);
+	builtinStatus.start(statusModules, [](const std::string& id, const std::string& text) {
+		setStatusBlock(id, text);
+	});
+
+	loop.run();
 	cleanup();
 }
 
@@ -571,13 +1057,10 @@ void requireGlobal(const void* p, const char* name)
 
 void waylandFlush()
 {
+	auto trace = TraceSpan {"waylandFlush"};
 	wl_display_dispatch_pending(display);
 	if (wl_display_flush(display) < 0 && errno == EAGAIN) {
-		for (auto& ev : pollfds) {
-			if (ev.fd == displayFd) {
-				ev.events |= POLLOUT;
-			}
-		}
+		EventLoop::get().modify(displayFd, EPOLLIN | EPOLLOUT);
 	}
 }
 
@@ -593,6 +1076,9 @@ void setCloexec(int fd)
 }
 
 void cleanup() {
+	tracer.flush();
+	capture.close();
+	controlSocket.close();
 	if (!statusFifoName.empty()) {
 		unlink(statusFifoName.c_str());
 	}
@@ -0,0 +1,77 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include "glyph_atlas.hpp"
+#include "layout_cache.hpp"
+#include "metrics.hpp"
+#include "shm_buffer.hpp"
+
+Metrics metrics;
+
+static void counter(std::string& out, const char* name, uint64_t value)
+{
+	out += "somebar_";
+	out += name;
+	out += ' ';
+	out += std::to_string(value);
+	out += '\n';
+}
+
+void Histogram::dump(std::string& out, const char* name) const
+{
+	auto prefix = std::string {"somebar_"} + name;
+	auto cumulative = uint64_t {0};
+	for (auto i = 0u; i < _buckets.size() && cumulative < count; i++) {
+		cumulative += _buckets[i];
+		if (_buckets[i]) {
+			out += prefix + "_bucket{le=\"" + std::to_string((uint64_t {1} << i) - 1) + "\"} "
+				+ std::to_string(cumulative) + "\n";
+		}
+	}
+	out += prefix + "_bucket{le=\"+Inf\"} " + std::to_string(count) + "\n";
+	out += prefix + "_sum " + std::to_string(sum) + "\n";
+	out += prefix + "_count " + std::to_string(count) + "\n";
+	out += prefix + "_max " + std::to_string(max) + "\n";
+}
+
+std::string Metrics::dump() const
+{
+	auto out = std::string {};
+	paint.dump(out, "paint_ns");
+	paintTags.dump(out, "paint_tags_ns");
+	paintLayout.dump(out, "paint_layout_ns");
+	paintTitle.dump(out, "paint_title_ns");
+	paintStatus.dump(out, "paint_status_ns");
+	counter(out, "frames_requested", framesRequested);
+	counter(out, "frames_coalesced", framesCoalesced);
+	counter(out, "frames_committed", framesCommitted);
+	counter(out, "frames_empty", framesEmpty);
+	counter(out, "frames_starved", framesStarved);
+	stdinReads.dump(out, "stdin_read_bytes");
+	fifoReads.dump(out, "fifo_read_bytes");
+	counter(out, "stdin_lines", stdinLines);
+	counter(out, "fifo_lines", fifoLines);
+	auto phase = [&](const char* name, uint64_t value) {
+		out += "somebar_startup_ns{phase=\"";
+		out += name;
+		out += "\"} " + std::to_string(value) + "\n";
+	};
+	phase("connected", startup.connected);
+	phase("globals", startup.globals);
+	phase("outputs", startup.outputs);
+	phase("font_loaded", startup.fontLoaded);
+	phase("first_configure", startup.firstConfigure);
+	phase("first_frame", startup.firstFrame);
+	counter(out, "startup_font_wait_ns", startup.fontWait);
+
+	counter(out, "shaping_calls", LayoutCache::get().stats.misses);
+	counter(out, "layout_cache_hits", LayoutCache::get().stats.hits);
+	counter(out, "glyph_atlas_hits", GlyphAtlas::get().stats.hits);
+	counter(out, "glyph_atlas_misses", GlyphAtlas::get().stats.misses);
+	counter(out, "glyph_atlas_resets", GlyphAtlas::get().stats.resets);
+	counter(out, "shm_buffers_allocated", ShmBuffer::stats.grown);
+	counter(out, "shm_buffers_waited", ShmBuffer::stats.waited);
+	counter(out, "shm_arena_grown", ShmArena::stats.grown);
+	counter(out, "shm_arena_bytes", ShmArena::stats.size);
+	return out;
+}
@@ -0,0 +1,85 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include <time.h>
+
+// histogram with power-of-two buckets: bucket i counts values with i
+// significant bits, i.e. up to 2^i - 1
+class Histogram {
+	std::array<uint64_t, 64> _buckets {};
+public:
+	uint64_t count {0};
+	uint64_t sum {0};
+	uint64_t max {0};
+
+	void add(uint64_t value)
+	{
+		auto bucket = value ? 64 - __builtin_clzll(value) : 0;
+		_buckets[bucket < 64 ? bucket : 63]++;
+		count++;
+		sum += value;
+		max = value > max ? value : max;
+	}
+	// in the prometheus text format, with cumulative le buckets
+	void dump(std::string& out, const char* name) const;
+};
+
+inline uint64_t nowNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+// adds the time from construction to destruction to a histogram
+class ScopedTimer {
+	Histogram& _histogram;
+	uint64_t _start;
+public:
+	explicit ScopedTimer(Histogram& histogram) : _histogram {histogram}, _start {nowNs()} { }
+	~ScopedTimer() { _histogram.add(nowNs() - _start); }
+};
+
+// costs of the hot paths. times are in nanoseconds.
+struct Metrics {
+	// Bar::paint, and its parts
+	Histogram paint, paintTags, paintLayout, paintTitle, paintStatus;
+	// frames requested by Bar::invalidate, and invalidations folded into an
+	// already requested frame
+	uint64_t framesRequested {0};
+	uint64_t framesCoalesced {0};
+	// frames committed, frames with nothing to redraw, and frames that had
+	// to wait for the compositor to release a buffer
+	uint64_t framesCommitted {0};
+	uint64_t framesEmpty {0};
+	uint64_t framesStarved {0};
+	// bytes per read(), and lines
+	Histogram stdinReads, fifoReads;
+	uint64_t stdinLines {0};
+	uint64_t fifoLines {0};
+
+	// when main() started, and when startup reached each phase, in
+	// nanoseconds since then. zero until the phase is reached.
+	uint64_t startTime {0};
+	struct {
+		uint64_t connected, globals, outputs, fontLoaded, firstConfigure, firstFrame;
+		// how long the first bar waited for the font thread
+		uint64_t fontWait;
+	} startup {};
+	void startupPhase(uint64_t& phase)
+	{
+		if (!phase && startTime) {
+			phase = nowNs() - startTime;
+		}
+	}
+
+	// all metrics, including the counters of the caches and buffers, in the
+	// prometheus text format
+	std::string dump() const;
+};
+
+extern Metrics metrics;
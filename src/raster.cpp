@@ -0,0 +1,72 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include "raster.hpp"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+static void fillSpanGeneric(uint32_t* dst, int n, uint32_t pixel)
+{
+	std::fill_n(dst, n, pixel);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+static void fillSpanSse2(uint32_t* dst, int n, uint32_t pixel)
+{
+	auto v = _mm_set1_epi32(pixel);
+	auto i = 0;
+	for (; i+4 <= n; i += 4) {
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+i), v);
+	}
+	for (; i < n; i++) {
+		dst[i] = pixel;
+	}
+}
+
+__attribute__((target("avx2")))
+static void fillSpanAvx2(uint32_t* dst, int n, uint32_t pixel)
+{
+	auto v = _mm256_set1_epi32(pixel);
+	auto i = 0;
+	for (; i+8 <= n; i += 8) {
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+i), v);
+	}
+	for (; i < n; i++) {
+		dst[i] = pixel;
+	}
+}
+#endif
+
+using FillSpan = void (*)(uint32_t* dst, int n, uint32_t pixel);
+static FillSpan selectFillSpan()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return fillSpanAvx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return fillSpanSse2;
+	}
+#endif
+	return fillSpanGeneric;
+}
+static const FillSpan fillSpan = selectFillSpan();
+
+void fillRect(const Canvas& canvas, int x, int y, int width, int height, uint32_t pixel)
+{
+	auto x0 = std::max(x, 0);
+	auto x1 = std::min(x+width, canvas.width);
+	auto y0 = std::max(y, 0);
+	auto y1 = std::min(y+height, canvas.height);
+	if (x0 >= x1) {
+		return;
+	}
+	for (auto row = y0; row < y1; row++) {
+		auto dst = reinterpret_cast<uint32_t*>(canvas.data + row*canvas.stride);
+		fillSpan(dst+x0, x1-x0, pixel);
+	}
+}
@@ -0,0 +1,34 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include "common.hpp"
+
+// raw pixels of a 32-bit shm buffer
+struct Canvas {
+	uint8_t* data;
+	int width, height, stride;
+};
+
+// premultiplied ARGB8888 pixel words
+struct PixelScheme {
+	uint32_t fg, bg;
+};
+
+constexpr uint32_t toPixel(const Color& color)
+{
+	return uint32_t {color.a} << 24
+		| uint32_t {color.r} * color.a / 255 << 16
+		| uint32_t {color.g} * color.a / 255 << 8
+		| uint32_t {color.b} * color.a / 255;
+}
+
+constexpr PixelScheme toPixels(const ColorScheme& scheme)
+{
+	return {toPixel(scheme.fg), toPixel(scheme.bg)};
+}
+
+// fills the rectangle with pixel, clipped to the canvas. uses the widest
+// vector instructions the cpu supports.
+void fillRect(const Canvas& canvas, int x, int y, int width, int height, uint32_t pixel);
@@ -1,6 +1,7 @@
 // somebar - dwl bar
 // See LICENSE file for copyright and license details.
 
+#include <algorithm>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
@@ -9,52 +10,233 @@
 #include "common.hpp"
 
 static int createAnonShm();
-constexpr int n = 2;
 
-ShmBuffer::ShmBuffer(int w, int h, wl_shm_format format)
-	: width(w)
-	, height(h)
-	, stride(w*4)
+ShmBuffer::Stats ShmBuffer::stats;
+
+const wl_buffer_listener ShmBuffer::_bufferListener = {
+	[](void* data, wl_buffer*)
+	{
+		auto buf = static_cast<Buf*>(data);
+		auto owner = buf->owner;
+		if (!owner) {
+			ShmArena::get().free(buf->block);
+			retired().remove_if([buf](const Buf& other) { return &other == buf; });
+			return;
+		}
+		buf->busy = false;
+		if (owner->_starved && owner->onRelease) {
+			owner->_starved = false;
+			owner->onRelease();
+		}
+	}
+};
+
+// address space reserved for the arena. only the part backed by the file is
+// ever touched.
+constexpr size_t arenaReserve = size_t {256} << 20;
+constexpr size_t arenaGranularity = size_t {1} << 20;
+constexpr size_t blockAlignment = 64;
+
+ShmArena::Stats ShmArena::stats;
+
+ShmArena& ShmArena::get()
+{
+	// never destroyed, so buffers can still be freed during static destruction
+	static auto arena = new ShmArena;
+	return *arena;
+}
+
+ShmArena::ShmArena()
 {
-	auto oneSize = stride*size_t(h);
-	auto totalSize = oneSize * n;
-	auto fd = createAnonShm();
-	if (fd < 0) {
+	_fd = createAnonShm();
+	if (_fd < 0) {
 		diesys("memfd_create");
 	}
-	if (ftruncate(fd, totalSize) < 0) {
+	auto ptr = mmap(nullptr, arenaReserve, PROT_NONE, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (ptr == MAP_FAILED) {
+		diesys("mmap");
+	}
+	_reservation = MemoryMapping {ptr, arenaReserve};
+	_base = static_cast<uint8_t*>(ptr);
+}
+
+void ShmArena::grow(size_t minSize)
+{
+	auto newSize = (minSize + arenaGranularity - 1) / arenaGranularity * arenaGranularity;
+	if (newSize > arenaReserve) {
+		die("shm arena exhausted");
+	}
+	if (ftruncate(_fd, newSize) < 0) {
 		diesys("ftruncate");
 	}
-	auto pool = wl_shm_create_pool(shm, fd, totalSize);
-	auto ptr = reinterpret_cast<uint8_t*>(mmap(nullptr, totalSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
-	if (!ptr) {
+	auto ptr = mmap(_base + _size, newSize - _size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_FIXED, _fd, _size);
+	if (ptr == MAP_FAILED) {
 		diesys("mmap");
 	}
-	_mapping = MemoryMapping {ptr, totalSize};
-	close(fd);
-	for (auto i=0; i<n; i++) {
-		auto offset = oneSize*i;
-		_buffers[i] = {
-			ptr+offset,
-			wl_unique_ptr<wl_buffer> { wl_shm_pool_create_buffer(pool, offset, width, height, stride, format) },
-		};
+	if (_pool) {
+		wl_shm_pool_resize(_pool, newSize);
+	} else {
+		_pool = wl_shm_create_pool(shm, _fd, newSize);
 	}
-	wl_shm_pool_destroy(pool);
+	free({_size, newSize - _size});
+	_size = newSize;
+	stats.grown++;
+	stats.size = _size;
+}
+
+ShmArena::Block ShmArena::allocate(size_t size)
+{
+	size = (size + blockAlignment - 1) / blockAlignment * blockAlignment;
+	auto it = std::find_if(_free.begin(), _free.end(), [size](const auto& f) { return f.second >= size; });
+	if (it == _free.end()) {
+		// extend the free block at the end of the arena, if any
+		auto tail = size_t {0};
+		if (!_free.empty()) {
+			auto last = std::prev(_free.end());
+			if (last->first + last->second == _size) {
+				tail = last->second;
+			}
+		}
+		grow(_size + size - tail);
+		it = std::find_if(_free.begin(), _free.end(), [size](const auto& f) { return f.second >= size; });
+	}
+	auto block = Block {it->first, size};
+	auto remaining = it->second - size;
+	_free.erase(it);
+	if (remaining) {
+		_free.emplace(block.offset + size, remaining);
+	}
+	return block;
+}
+
+void ShmArena::free(Block block)
+{
+	if (!block.size) {
+		return;
+	}
+	auto it = _free.emplace(block.offset, block.size).first;
+	auto next = std::next(it);
+	if (next != _free.end() && it->first + it->second == next->first) {
+		it->second += next->second;
+		_free.erase(next);
+	}
+	if (it != _free.begin()) {
+		auto prev = std::prev(it);
+		if (prev->first + prev->second == it->first) {
+			prev->second += it->second;
+			_free.erase(it);
+		}
+	}
+}
+
+ShmBuffer::ShmBuffer(int w, int h, wl_shm_format format)
+	: _format(format)
+	, width(w)
+	, height(h)
+	, stride(w*4)
+{
+	allocate();
+	allocate();
+}
+
+ShmBuffer::~ShmBuffer()
+{
+	for (auto it = _buffers.begin(); it != _buffers.end(); ) {
+		auto next = std::next(it);
+		if (it->busy) {
+			it->owner = nullptr;
+			it->painter.reset();
+			it->surface.reset();
+			retired().splice(retired().end(), _buffers, it);
+		} else {
+			ShmArena::get().free(it->block);
+		}
+		it = next;
+	}
+}
+
+std::list<ShmBuffer::Buf>& ShmBuffer::retired()
+{
+	// never destroyed, like the arena the blocks go back to
+	static auto buffers = new std::list<Buf>;
+	return *buffers;
+}
+
+void ShmBuffer::allocate()
+{
+	auto& arena = ShmArena::get();
+	auto block = arena.allocate(stride*size_t(height));
+	auto& buf = _buffers.emplace_back(Buf {
+		this,
+		block,
+		arena.data(block),
+		wl_unique_ptr<wl_buffer> { wl_shm_pool_create_buffer(arena.pool(), block.offset, width, height, stride, _format) },
+	});
+	wl_buffer_add_listener(buf.buffer.get(), &_bufferListener, &buf);
+	buf.surface.reset(cairo_image_surface_create_for_data(
+		buf.data, CAIRO_FORMAT_ARGB32, width, height, stride));
+	buf.painter.reset(cairo_create(buf.surface.get()));
+	buf.missing.add({0, static_cast<int>(width)});
+}
+
+bool ShmBuffer::acquire()
+{
+	auto it = std::find_if(_buffers.begin(), _buffers.end(), [](const Buf& buf) { return !buf.busy; });
+	if (it == _buffers.end()) {
+		if (_buffers.size() >= maxBuffers) {
+			stats.waited++;
+			_starved = true;
+			return false;
+		}
+		stats.grown++;
+		allocate();
+		it = std::prev(_buffers.end());
+	}
+	_current = &*it;
+	if (_last) {
+		cairo_surface_flush(_current->surface.get());
+		for (auto span : _current->missing) {
+			auto x = std::max(span.x, 0);
+			auto w = std::min(span.end(), static_cast<int>(width)) - x;
+			if (w <= 0) {
+				continue;
+			}
+			for (auto y = 0u; y < height; y++) {
+				auto offset = y*stride + x*4;
+				std::copy_n(_last->data+offset, w*4, _current->data+offset);
+			}
+		}
+		cairo_surface_mark_dirty(_current->surface.get());
+	}
+	_current->missing.clear();
+	return true;
 }
 
 uint8_t* ShmBuffer::data()
 {
-	return _buffers[_current].data;
+	return _current->data;
 }
 
 wl_buffer* ShmBuffer::buffer()
 {
-	return _buffers[_current].buffer.get();
+	return _current->buffer.get();
 }
 
-void ShmBuffer::flip()
+cairo_t* ShmBuffer::painter()
 {
-	_current = 1-_current;
+	return _current->painter.get();
+}
+
+void ShmBuffer::commit(const Damage& damage)
+{
+	for (auto& buf : _buffers) {
+		if (&buf != _current) {
+			buf.missing.add(damage);
+		}
+	}
+	_current->busy = true;
+	_last = _current;
 }
 
 #if defined(__linux__)
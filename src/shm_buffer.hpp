@@ -2,10 +2,13 @@
 // See LICENSE file for copyright and license details.
 
 #pragma once
-#include <array>
+#include <functional>
+#include <list>
+#include <map>
 #include <sys/mman.h>
 #include <wayland-client.h>
 #include "common.hpp"
+#include "damage.hpp"
 
 class MemoryMapping {
 	void* _ptr {nullptr};
@@ -25,21 +28,96 @@ public:
 	}
 };
 
-// double buffered shm
+// process-wide shm pool that all buffers are sub-allocated from. the file
+// grows in place inside a reserved address range, so existing pointers stay
+// valid and resizing a bar or adding an output rarely needs a new mapping.
+class ShmArena {
+	int _fd {-1};
+	wl_shm_pool* _pool {nullptr};
+	MemoryMapping _reservation;
+	uint8_t* _base {nullptr};
+	size_t _size {0};
+	// offset -> size
+	std::map<size_t, size_t> _free;
+
+	ShmArena();
+	void grow(size_t minSize);
+public:
+	struct Block {
+		size_t offset {0};
+		size_t size {0};
+	};
+	struct Stats {
+		unsigned long grown;
+		size_t size;
+	};
+	static Stats stats;
+
+	static ShmArena& get();
+	Block allocate(size_t size);
+	void free(Block block);
+	uint8_t* data(const Block& block) { return _base + block.offset; }
+	wl_shm_pool* pool() { return _pool; }
+};
+
+// pool of shm buffers that are reused once the compositor releases them.
+// starts out double buffered, and grows to a third buffer only if both are
+// still held by the compositor.
 // format is must be 32-bit
 class ShmBuffer {
 	struct Buf {
+		// null once the pool is destroyed while the compositor holds the buffer
+		ShmBuffer* owner;
+		ShmArena::Block block;
 		uint8_t* data {nullptr};
 		wl_unique_ptr<wl_buffer> buffer;
+		wl_unique_ptr<cairo_surface_t> surface;
+		wl_unique_ptr<cairo_t> painter;
+		bool busy {false};
+		// spans that were redrawn in other buffers since this one was last drawn
+		Damage missing;
 	};
-	std::array<Buf, 2> _buffers;
-	int _current {0};
-	MemoryMapping _mapping;
+	static const wl_buffer_listener _bufferListener;
+	// buffers of destroyed pools that the compositor still held. their
+	// blocks stay out of the arena until the release arrives, so a new pool
+	// cannot draw into memory that is still on screen.
+	static std::list<Buf>& retired();
+
+	std::list<Buf> _buffers;
+	Buf* _current {nullptr};
+	Buf* _last {nullptr};
+	bool _starved {false};
+	wl_shm_format _format;
+
+	void allocate();
 public:
+	struct Stats {
+		unsigned long grown;
+		unsigned long waited;
+	};
+	static constexpr int maxBuffers = 3;
+	// process-wide counters
+	static Stats stats;
+
 	const uint32_t width, height, stride;
+	// called when a buffer is released while acquire() had failed
+	std::function<void()> onRelease;
 
 	explicit ShmBuffer(int width, int height, wl_shm_format format);
+	// pinned, the buffer listeners point into it
+	ShmBuffer(const ShmBuffer&) = delete;
+	ShmBuffer(ShmBuffer&&) = delete;
+	ShmBuffer& operator=(const ShmBuffer&) = delete;
+	ShmBuffer& operator=(ShmBuffer&&) = delete;
+	~ShmBuffer();
+
+	// picks a buffer that is not held by the compositor and brings it up to
+	// date with the last committed one. returns false if all buffers are busy.
+	bool acquire();
 	uint8_t* data();
 	wl_buffer* buffer();
-	void flip();
+	cairo_t* painter();
+	// marks the current buffer as held by the compositor. damage is the region
+	// that was redrawn since acquire().
+	void commit(const Damage& damage);
 };
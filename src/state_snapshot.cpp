@@ -0,0 +1,111 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "state_snapshot.hpp"
+
+constexpr uint32_t snapshotMagic = 0x53425354; // "SBST"
+// bump when the layout of Snapshot changes
+constexpr uint32_t snapshotVersion = 1;
+
+bool StateSnapshot::open(const std::string& path)
+{
+	close();
+	// titles are private, only the user may read them
+	_fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+	if (_fd < 0) {
+		return false;
+	}
+	// released by the kernel if we crash
+	struct stat st;
+	if (flock(_fd, LOCK_EX | LOCK_NB) < 0 || fstat(_fd, &st) < 0) {
+		close();
+		return false;
+	}
+	auto fresh = static_cast<size_t>(st.st_size) != sizeof(Snapshot);
+	if (fresh && (ftruncate(_fd, 0) < 0 || ftruncate(_fd, sizeof(Snapshot)) < 0)) {
+		close();
+		return false;
+	}
+	auto p = mmap(nullptr, sizeof(Snapshot), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (p == MAP_FAILED) {
+		close();
+		return false;
+	}
+	_snapshot = static_cast<Snapshot*>(p);
+	if (fresh || _snapshot->magic != snapshotMagic || _snapshot->version != snapshotVersion) {
+		memset(_snapshot, 0, sizeof(Snapshot));
+		_snapshot->magic = snapshotMagic;
+		_snapshot->version = snapshotVersion;
+	}
+	return true;
+}
+
+void StateSnapshot::close()
+{
+	if (_snapshot) {
+		munmap(_snapshot, sizeof(Snapshot));
+		_snapshot = nullptr;
+	}
+	if (_fd >= 0) {
+		::close(_fd);
+		_fd = -1;
+	}
+}
+
+const SnapshotMonitor* StateSnapshot::findMonitor(std::string_view name) const
+{
+	if (!_snapshot || name.empty()) {
+		return nullptr;
+	}
+	for (const auto& mon : _snapshot->monitors) {
+		if (mon.name.length && mon.name.view() == name) {
+			return &mon;
+		}
+	}
+	return nullptr;
+}
+
+SnapshotMonitor* StateSnapshot::monitor(std::string_view name)
+{
+	// longer names would not be found again
+	if (!_snapshot || name.empty() || name.size() > sizeof(SnapshotMonitor::name.data)) {
+		return nullptr;
+	}
+	SnapshotMonitor* unused = nullptr;
+	for (auto& mon : _snapshot->monitors) {
+		if (!mon.name.length) {
+			unused = unused ? unused : &mon;
+		} else if (mon.name.view() == name) {
+			return &mon;
+		}
+	}
+	auto mon = unused ? unused : &std::end(_snapshot->monitors)[-1];
+	memset(mon, 0, sizeof(*mon));
+	mon->name.assign(name);
+	return mon;
+}
+
+void StateSnapshot::setBlock(std::string_view id, std::string_view text)
+{
+	if (!_snapshot || id.empty() || id.size() > sizeof(SnapshotBlock::id.data)) {
+		return;
+	}
+	SnapshotBlock* unused = nullptr;
+	for (auto& block : _snapshot->blocks) {
+		if (!block.id.length) {
+			unused = unused ? unused : &block;
+		} else if (block.id.view() == id) {
+			block.text.assign(text);
+			return;
+		}
+	}
+	if (unused) {
+		unused->text.assign(text);
+		unused->id.assign(id);
+	}
+}
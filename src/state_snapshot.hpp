@@ -0,0 +1,91 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// last known state of every monitor and status block, kept in a small
+// shared mapping of a file so that a restarted somebar can draw the bar
+// before dwl and the status producers speak again. updates are copies into
+// the mapping, without system calls. a somebar that crashes mid-update may
+// leave one string torn, which is replaced by the next fresh line.
+
+template<size_t N>
+struct SnapshotString {
+	uint16_t length;
+	char data[N];
+
+	std::string_view view() const { return {data, std::min<size_t>(length, N)}; }
+	void assign(std::string_view text)
+	{
+		auto n = std::min(text.size(), N);
+		// don't cut a UTF-8 sequence in half, pango rejects the rest
+		while (n < text.size() && n > 0 && (text[n] & 0xc0) == 0x80) {
+			n--;
+		}
+		memcpy(data, text.data(), n);
+		length = n;
+	}
+};
+
+struct SnapshotMonitor {
+	// xdg_output name, empty for an unused slot
+	SnapshotString<32> name;
+	uint32_t occupied, tags, clientTags, urgent;
+	uint8_t selected;
+	uint8_t visible;
+	SnapshotString<32> layout;
+	SnapshotString<256> title;
+};
+
+struct SnapshotBlock {
+	SnapshotString<32> id;
+	SnapshotString<256> text;
+};
+
+struct Snapshot {
+	uint32_t magic;
+	uint32_t version;
+	SnapshotMonitor monitors[8];
+	SnapshotBlock blocks[16];
+};
+
+class StateSnapshot {
+	int _fd {-1};
+	Snapshot* _snapshot {nullptr};
+public:
+	StateSnapshot() = default;
+	StateSnapshot(const StateSnapshot&) = delete;
+	StateSnapshot& operator=(const StateSnapshot&) = delete;
+	~StateSnapshot() { close(); }
+
+	// maps path, and starts a new snapshot if it holds none. returns false
+	// if it cannot be opened, or another somebar uses it.
+	bool open(const std::string& path);
+	void close();
+	bool isOpen() const { return _snapshot; }
+
+	const SnapshotMonitor* findMonitor(std::string_view name) const;
+	// finds or creates the slot for name. replaces the last slot when all
+	// are taken.
+	SnapshotMonitor* monitor(std::string_view name);
+	// blocks beyond the 16th, and ids and names longer than 32 bytes are not
+	// kept
+	void setBlock(std::string_view id, std::string_view text);
+	template<typename F>
+	void forEachBlock(const F& f) const
+	{
+		if (!_snapshot) {
+			return;
+		}
+		for (const auto& block : _snapshot->blocks) {
+			if (block.id.length) {
+				f(block.id.view(), block.text.view());
+			}
+		}
+	}
+};
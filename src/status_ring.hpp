@@ -0,0 +1,202 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// shared memory channel for status producers that update many times per
+// second. the producer creates a sealed memfd holding a ring of records and
+// an eventfd, and hands both to somebar with "ring BLOCK" on the control
+// socket. it then writes records into the ring and rings the eventfd. somebar
+// shows the newest record as the text of BLOCK, and skips older ones. the
+// ring is dropped when the producer closes its control socket connection.
+//
+// this header has no dependencies on the rest of somebar, so producers can
+// copy it.
+
+constexpr uint32_t statusRingMagic = 0x53425247; // "SBRG"
+constexpr uint32_t statusRingVersion = 1;
+// the header is followed by slotCount slots of slotSize bytes
+constexpr size_t statusRingHeaderSize = 64;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "status ring needs lock-free 64-bit atomics");
+
+struct StatusRingHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+	// sequence number of the newest complete record. records start at 1.
+	std::atomic<uint64_t> sequence;
+};
+
+// record n is written to slot n % slotCount. the text follows the slot.
+struct StatusRingSlot {
+	// sequence number of the record in the slot, 0 while it is written
+	std::atomic<uint64_t> sequence;
+	uint32_t length;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(StatusRingHeader) <= statusRingHeaderSize);
+
+// slotCount and slotSize are passed in, the consumer must not trust the
+// header once it has checked them
+inline StatusRingSlot* statusRingSlot(const StatusRingHeader* ring, uint32_t slotCount,
+	uint32_t slotSize, uint64_t sequence)
+{
+	auto base = reinterpret_cast<uintptr_t>(ring) + statusRingHeaderSize;
+	return reinterpret_cast<StatusRingSlot*>(base + (sequence % slotCount) * slotSize);
+}
+
+inline StatusRingSlot* statusRingSlot(const StatusRingHeader* ring, uint64_t sequence)
+{
+	return statusRingSlot(ring, ring->slotCount, ring->slotSize, sequence);
+}
+
+inline const char* statusRingText(const StatusRingSlot* slot)
+{
+	return reinterpret_cast<const char*>(slot + 1);
+}
+
+// producer side. not thread-safe, there must be a single writer per ring.
+class StatusRingProducer {
+	int _socket {-1};
+	int _eventFd {-1};
+	StatusRingHeader* _ring {nullptr};
+	size_t _size {0};
+
+	bool fail()
+	{
+		close();
+		return false;
+	}
+public:
+	StatusRingProducer() = default;
+	StatusRingProducer(const StatusRingProducer&) = delete;
+	StatusRingProducer& operator=(const StatusRingProducer&) = delete;
+	~StatusRingProducer() { close(); }
+
+	// defaults to $XDG_RUNTIME_DIR/somebar-0.sock
+	static std::string defaultSocket()
+	{
+		auto dir = getenv("XDG_RUNTIME_DIR");
+		return std::string {dir ? dir : "/tmp"} + "/somebar-0.sock";
+	}
+
+	// registers a ring for block. texts longer than slotSize - 16 bytes are
+	// truncated.
+	bool open(std::string_view block, const std::string& socketPath = defaultSocket(),
+		uint32_t slotCount = 8, uint32_t slotSize = 1024)
+	{
+		close();
+		if (!slotCount || slotSize <= sizeof(StatusRingSlot) || slotSize % 8) {
+			return false;
+		}
+		auto addr = sockaddr_un {};
+		addr.sun_family = AF_UNIX;
+		if (socketPath.size() >= sizeof(addr.sun_path)) {
+			return false;
+		}
+		memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+		_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+		if (_socket < 0 || connect(_socket, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+			return fail();
+		}
+
+		_size = statusRingHeaderSize + size_t {slotCount} * slotSize;
+		auto memFd = memfd_create("somebar-status-ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+		if (memFd < 0) {
+			return fail();
+		}
+		// somebar only maps rings that cannot shrink under it
+		if (ftruncate(memFd, _size) < 0 || fcntl(memFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_SEAL) < 0) {
+			::close(memFd);
+			return fail();
+		}
+		auto p = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+		if (p == MAP_FAILED) {
+			::close(memFd);
+			return fail();
+		}
+		_ring = new (p) StatusRingHeader {statusRingMagic, statusRingVersion, slotCount, slotSize, {0}};
+		_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		if (_eventFd < 0) {
+			::close(memFd);
+			return fail();
+		}
+
+		auto command = "ring " + std::string {block};
+		auto iov = iovec {command.data(), command.size()};
+		alignas(cmsghdr) char control[CMSG_SPACE(2 * sizeof(int))] {};
+		auto msg = msghdr {};
+		msg.msg_iov = &iov;
+		msg.msg_iovlen = 1;
+		msg.msg_control = control;
+		msg.msg_controllen = sizeof(control);
+		auto cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+		int fds[2] = {memFd, _eventFd};
+		memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+		auto sent = sendmsg(_socket, &msg, MSG_NOSIGNAL);
+		::close(memFd);
+		char reply[256];
+		if (sent < 0 || recv(_socket, reply, sizeof(reply), 0) < 2 || memcmp(reply, "ok", 2)) {
+			return fail();
+		}
+		return true;
+	}
+
+	bool isOpen() const { return _ring; }
+
+	// publishing never blocks. records somebar has not read yet are skipped.
+	void publish(std::string_view text)
+	{
+		if (!_ring) {
+			return;
+		}
+		auto sequence = _ring->sequence.load(std::memory_order_relaxed) + 1;
+		auto slot = statusRingSlot(_ring, sequence);
+		auto length = std::min(text.size(), size_t {_ring->slotSize} - sizeof(StatusRingSlot));
+		slot->sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		memcpy(const_cast<char*>(statusRingText(slot)), text.data(), length);
+		slot->length = length;
+		slot->sequence.store(sequence, std::memory_order_release);
+		_ring->sequence.store(sequence, std::memory_order_release);
+		uint64_t one = 1;
+		// EAGAIN means the counter is full, somebar will wake up anyway
+		(void) !write(_eventFd, &one, sizeof(one));
+	}
+
+	void close()
+	{
+		if (_ring) {
+			munmap(_ring, _size);
+			_ring = nullptr;
+		}
+		if (_eventFd >= 0) {
+			::close(_eventFd);
+			_eventFd = -1;
+		}
+		if (_socket >= 0) {
+			::close(_socket);
+			_socket = -1;
+		}
+	}
+};
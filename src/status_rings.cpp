@@ -0,0 +1,114 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <algorithm>
+#include <iterator>
+#include <sys/stat.h>
+#include "event_loop.hpp"
+#include "status_rings.hpp"
+
+// epoll refuses files and devices, and watch() dies when it does. anything
+// else can stand in for an eventfd, reading it only drains it.
+static bool isPollable(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 && !S_ISREG(st.st_mode) && !S_ISDIR(st.st_mode)
+		&& !S_ISSOCK(st.st_mode) && !S_ISCHR(st.st_mode) && !S_ISBLK(st.st_mode);
+}
+
+bool StatusRings::attach(int client, std::string_view block, int memFd, int eventFd, std::string& error)
+{
+	struct stat st;
+	if (fstat(memFd, &st) < 0 || static_cast<size_t>(st.st_size) < statusRingHeaderSize) {
+		error = "ring too small";
+		return false;
+	}
+	// a producer could otherwise truncate the file and make us crash with SIGBUS
+	auto seals = fcntl(memFd, F_GET_SEALS);
+	if (seals < 0 || !(seals & F_SEAL_SHRINK)) {
+		error = "ring must be sealed against shrinking";
+		return false;
+	}
+	auto size = static_cast<size_t>(st.st_size);
+	auto p = mmap(nullptr, size, PROT_READ, MAP_SHARED, memFd, 0);
+	if (p == MAP_FAILED) {
+		error = "mmap failed";
+		return false;
+	}
+	auto header = static_cast<const StatusRingHeader*>(p);
+	// read once, the producer may rewrite the header after the checks
+	auto slotCount = *static_cast<volatile const uint32_t*>(&header->slotCount);
+	auto slotSize = *static_cast<volatile const uint32_t*>(&header->slotSize);
+	if (header->magic != statusRingMagic || header->version != statusRingVersion
+		|| !slotCount || slotSize <= sizeof(StatusRingSlot) || slotSize % 8
+		|| statusRingHeaderSize + uint64_t {slotCount} * slotSize > size) {
+		munmap(p, size);
+		error = "bad ring header";
+		return false;
+	}
+	if (!isPollable(eventFd)) {
+		munmap(p, size);
+		error = "ring needs an eventfd";
+		return false;
+	}
+	// our end only reads, and must not block when the counter is zero
+	fcntl(eventFd, F_SETFL, fcntl(eventFd, F_GETFL) | O_NONBLOCK);
+
+	auto& ring = _rings.emplace_back(Ring {client, std::string {block}, eventFd, header, size,
+		slotCount, slotSize, 0});
+	auto it = std::prev(_rings.end());
+	EventLoop::get().watch(eventFd, EPOLLIN, [this, it](uint32_t) { onEvent(*it); });
+	// the producer may have published before we were watching
+	onEvent(ring);
+	return true;
+}
+
+void StatusRings::onEvent(Ring& ring)
+{
+	uint64_t count;
+	while (read(ring.eventFd, &count, sizeof(count)) > 0) {
+	}
+	// bounded, a producer that died while writing leaves a slot behind that
+	// never becomes valid
+	for (auto attempt = 0; attempt < 8; attempt++) {
+		auto sequence = ring.header->sequence.load(std::memory_order_acquire);
+		if (sequence == ring.seen) {
+			return;
+		}
+		auto slot = statusRingSlot(ring.header, ring.slotCount, ring.slotSize, sequence);
+		if (slot->sequence.load(std::memory_order_acquire) != sequence) {
+			// overwritten since, the newer record is read next
+			continue;
+		}
+		auto length = std::min<size_t>(slot->length, ring.slotSize - sizeof(StatusRingSlot));
+		auto text = std::string_view {statusRingText(slot), length};
+		// onRecord copies the text. if the producer overwrote the slot
+		// meanwhile, the newer record replaces it before anything is drawn.
+		if (onRecord) {
+			onRecord(ring.block, text);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->sequence.load(std::memory_order_relaxed) == sequence) {
+			ring.seen = sequence;
+		}
+	}
+}
+
+void StatusRings::remove(std::list<Ring>::iterator ring)
+{
+	EventLoop::get().unwatch(ring->eventFd);
+	close(ring->eventFd);
+	munmap(const_cast<StatusRingHeader*>(ring->header), ring->size);
+	_rings.erase(ring);
+}
+
+void StatusRings::detach(int client)
+{
+	for (auto it = _rings.begin(); it != _rings.end(); ) {
+		auto next = std::next(it);
+		if (it->client == client) {
+			remove(it);
+		}
+		it = next;
+	}
+}
@@ -0,0 +1,39 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <string_view>
+#include "status_ring.hpp"
+
+// consumer side of the status rings in status_ring.hpp. wakes up on the
+// eventfd of a ring and passes its newest record to onRecord, as a view into
+// the shared memory.
+class StatusRings {
+	struct Ring {
+		int client;
+		std::string block;
+		int eventFd;
+		const StatusRingHeader* header;
+		size_t size;
+		// copied from the header when attaching, the producer can change it
+		uint32_t slotCount;
+		uint32_t slotSize;
+		uint64_t seen;
+	};
+	std::list<Ring> _rings;
+
+	void onEvent(Ring& ring);
+	void remove(std::list<Ring>::iterator ring);
+public:
+	std::function<void(std::string_view block, std::string_view text)> onRecord;
+
+	// takes ownership of eventFd. memFd is mapped and may be closed after.
+	// returns false and sets error if the ring is malformed.
+	bool attach(int client, std::string_view block, int memFd, int eventFd, std::string& error);
+	// drops the rings registered by client
+	void detach(int client);
+};
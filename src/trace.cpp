@@ -0,0 +1,55 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#include <cinttypes>
+#include <cstdio>
+#include <unistd.h>
+#include "trace.hpp"
+
+Tracer tracer;
+
+void Tracer::start(std::string path, size_t capacity)
+{
+	_path = std::move(path);
+	_events.assign(capacity ? capacity : 1, Event {});
+	_next = 0;
+	_wrapped = false;
+	enabled = true;
+}
+
+void Tracer::flush()
+{
+	if (!enabled) {
+		return;
+	}
+	auto tmp = _path + ".tmp";
+	auto f = fopen(tmp.c_str(), "we");
+	if (!f) {
+		perror("somebar: open trace");
+		return;
+	}
+	auto pid = static_cast<int>(getpid());
+	fputs("{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n", f);
+	auto first = true;
+	auto write = [&](const Event& e) {
+		// ts and dur are in microseconds
+		fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+			"\"ts\":%" PRIu64 ".%03" PRIu64 ",\"dur\":%" PRIu64 ".%03" PRIu64 "}",
+			first ? "" : ",\n", e.name, pid, pid,
+			e.start / 1000, e.start % 1000, (e.end - e.start) / 1000, (e.end - e.start) % 1000);
+		first = false;
+	};
+	if (_wrapped) {
+		for (auto i = _next; i < _events.size(); i++) {
+			write(_events[i]);
+		}
+	}
+	for (auto i = 0u; i < _next; i++) {
+		write(_events[i]);
+	}
+	fputs("\n]}\n", f);
+	if (fclose(f) != 0 || rename(tmp.c_str(), _path.c_str()) < 0) {
+		perror("somebar: write trace");
+		unlink(tmp.c_str());
+	}
+}
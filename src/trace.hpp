@@ -0,0 +1,56 @@
+// somebar - dwl bar
+// See LICENSE file for copyright and license details.
+
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "metrics.hpp"
+
+// timeline of what the event loop does, in the chrome trace event format
+// (chrome://tracing, ui.perfetto.dev). spans are recorded into a ring that is
+// allocated once, and only formatted when it is written out. when tracing is
+// off, a span costs a load and a branch.
+class Tracer {
+	struct Event {
+		const char* name;
+		uint64_t start;
+		uint64_t end;
+	};
+	std::vector<Event> _events;
+	size_t _next {0};
+	bool _wrapped {false};
+	std::string _path;
+public:
+	bool enabled {false};
+
+	// keeps the last capacity spans, and writes them to path on flush
+	void start(std::string path, size_t capacity = 65536);
+	// name must outlive the tracer, i.e. be a string literal
+	void add(const char* name, uint64_t start, uint64_t end)
+	{
+		_events[_next++] = {name, start, end};
+		if (_next == _events.size()) {
+			_next = 0;
+			_wrapped = true;
+		}
+	}
+	// rewrites the trace file with the recorded spans, oldest first
+	void flush();
+};
+
+extern Tracer tracer;
+
+// records the time from construction to destruction as a span
+class TraceSpan {
+	const char* _name;
+	uint64_t _start;
+public:
+	explicit TraceSpan(const char* name) : _name {name}, _start {tracer.enabled ? nowNs() : 0} { }
+	~TraceSpan()
+	{
+		if (_start) {
+			tracer.add(_name, _start, nowNs());
+		}
+	}
+};